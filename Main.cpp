@@ -5,19 +5,66 @@
 #include <ctime>
 #include <cmath>
 #include <fstream>
+#include <sstream>
 #include <map>
 #include <algorithm>
+#include <cstdio>
+#include <cstdarg>
+#include <cstring>
+#include <cctype>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <csignal>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unordered_map>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include <unistd.h>
+
+// ---------- Random Numbers ----------
+// Each world owns its generator (xorshift64*) so a run is reproducible from its seed and the state
+// can be checkpointed mid-run, which the hidden state behind rand() does not allow.
+struct Rng {
+    uint64_t state;
+
+    explicit Rng(uint64_t seed = 1) : state(seed ? seed : 0x9E3779B97F4A7C15ull) {}
+
+    // Non-negative like rand(), so "rng() % n - n/2" keeps working with signed arithmetic.
+    int operator()() {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return (int)((state * 0x2545F4914F6CDD1Dull) >> 33);
+    }
+};
 
 // ---------- Soil Structure ----------
 struct SoilCell {
     Vector2 position; // X,Z
     float water, nitrogen, phosphorus, potassium;
+    float organic; // soil organic matter, mineralized into nitrogen and phosphorus
 
-    SoilCell(Vector2 pos) : position(pos) {
-        water = 0.5f + (rand() % 50)/100.0f;
-        nitrogen = 0.5f + (rand() % 50)/100.0f;
-        phosphorus = 0.5f + (rand() % 50)/100.0f;
-        potassium = 0.5f + (rand() % 50)/100.0f;
+    SoilCell() = default;
+    SoilCell(Vector2 pos, Rng &rng) : position(pos) {
+        water = 0.5f + (rng() % 50)/100.0f;
+        nitrogen = 0.5f + (rng() % 50)/100.0f;
+        phosphorus = 0.5f + (rng() % 50)/100.0f;
+        potassium = 0.5f + (rng() % 50)/100.0f;
+        organic = 0.5f + (rng() % 50)/100.0f;
     }
 };
 
@@ -33,10 +80,11 @@ struct Plant {
     float maxAge;
     bool alive;
 
-    Plant(int _id, Vector3 pos, float s, float rate)
+    Plant() = default;
+    Plant(int _id, Vector3 pos, float s, float rate, Rng &rng)
         : id(_id), position(pos), size(s), growthRate(rate), alive(true) {
         health = 1.0f; age = 0.0f;
-        maxAge = 80.0f + (rand() % 40);
+        maxAge = 80.0f + (rng() % 40);
         color = {50,150,50,255};
     }
 
@@ -58,7 +106,7 @@ struct Plant {
     float calculateLight(const std::vector<Plant>& allPlants) {
         float light = 1.0f;
         for(auto &other : allPlants) {
-            if(other.id == id) continue;
+            if(other.id == id || !other.alive) continue;
             if(position.x + size/2 > other.position.x - other.size/2 &&
                position.x - size/2 < other.position.x + other.size/2 &&
                position.z + size/2 > other.position.z - other.size/2 &&
@@ -73,20 +121,23 @@ struct Plant {
     void grow(std::vector<SoilCell> &soil, int gridSize, float cellSize, const std::vector<Plant>& allPlants,
               std::map<int,std::map<int,float>> &nutrientUsed,
               std::map<int,std::vector<std::pair<int,float>>> &cellUsage,
-              float HEIGHT_SCALE) {
+              float HEIGHT_SCALE, Rng &rng, float dt = 1.0f, const std::vector<int> *rootCells = nullptr) {
 
         if(!alive) return;
 
         float lightFactor = calculateLight(allPlants);
-        auto indices = getOccupiedSoilIndices(gridSize, cellSize);
+        auto indices = rootCells ? *rootCells : getOccupiedSoilIndices(gridSize, cellSize);
 
+        // A plant that lost every cell to its neighbours takes up nothing this step.
         float nutrientFactor = 0.0f, waterFactor = 0.0f;
         for(int idx : indices) {
             nutrientFactor += (soil[idx].nitrogen + soil[idx].phosphorus + soil[idx].potassium)/3.0f;
             waterFactor += soil[idx].water;
         }
-        nutrientFactor /= indices.size();
-        waterFactor /= indices.size();
+        if(!indices.empty()) {
+            nutrientFactor /= indices.size();
+            waterFactor /= indices.size();
+        }
 
         float agePerc = age / maxAge;
         float delta = growthRate * lightFactor * nutrientFactor * waterFactor * 0.02f;
@@ -96,12 +147,13 @@ struct Plant {
         if(agePerc > 0.6f) delta *= 0.3f;
 
         if(delta > 0.05f) delta = 0.05f;
+        delta *= dt;
 
         size += delta;
-        if(agePerc > 0.6f) size -= 0.001f;
+        if(agePerc > 0.6f) size -= 0.001f * dt;
         if(size < 0.1f) size = 0.1f;
 
-        float deltaPerCell = delta / indices.size();
+        float deltaPerCell = indices.empty() ? 0.0f : delta / indices.size();
         for(int idx : indices) {
             soil[idx].water = std::max(0.0f, soil[idx].water - deltaPerCell*0.001f);
             soil[idx].nitrogen = std::max(0.0f, soil[idx].nitrogen - deltaPerCell*0.001f);
@@ -113,17 +165,17 @@ struct Plant {
         }
 
         health -= delta * 0.005f;
-        health -= (1.0f - nutrientFactor * waterFactor) * 0.0005f;
+        health -= (1.0f - nutrientFactor * waterFactor) * 0.0005f * dt;
         if(health < 0) health = 0;
 
-        age += 0.01f;
+        age += 0.01f * dt;
 
         if(agePerc > 0.6f) color.a = (unsigned char)((1.0f - (agePerc-0.6f)/0.4f) * 255);
         else color.a = 255;
 
         if(agePerc < 0.5f) {
-            float driftX = ((rand()%100)/50000.0f - 0.001f);
-            float driftZ = ((rand()%100)/50000.0f - 0.001f);
+            float driftX = ((rng()%100)/50000.0f - 0.001f) * dt;
+            float driftZ = ((rng()%100)/50000.0f - 0.001f) * dt;
             if(driftX > 0) position.x += driftX;
             if(driftZ > 0) position.z += driftZ;
         }
@@ -138,90 +190,2399 @@ struct Plant {
     }
 };
 
-// ---------- Main Program ----------
-int main() {
-    const int screenWidth = 1200, screenHeight = 800;
-    const int GRID_SIZE = 40;
-    const float CELL_SIZE = 1.0f;
-    const int NUM_PLANTS = 60;
-    const float HEIGHT_SCALE = 5.0f;
+// ---------- Seedling Cohorts ----------
+// Seedlings are far too numerous and short-lived to each get a Plant slot, so every soil cell
+// carries one super-individual: a member count with mean size, health and age. All cells are
+// advanced together in one pass over these flat arrays; members that reach PROMOTE_SIZE
+// become individual plants.
+struct SeedlingCohorts {
+    static constexpr float SEED_SIZE = 0.1f;
+    static constexpr float PROMOTE_SIZE = 0.5f;
+    static constexpr int MAX_PROMOTED = 2;      // survivors of self-thinning per cell
 
-    InitWindow(screenWidth, screenHeight, "3D Plant-Soil Ecosystem");
-    SetTargetFPS(60);
+    std::vector<float> count, size, health, age;
+    std::vector<float> uptake;                 // scratch for step(), not saved
 
-    Camera3D camera = {0};
-    camera.position = {30, 20, 30};
-    camera.target = {0, 0, 0};
-    camera.up = {0,1,0};
-    camera.fovy = 45.0f;
-    camera.projection = CAMERA_PERSPECTIVE;
+    void resize(int cells) {
+        count.assign(cells, 0.0f);
+        size.assign(cells, SEED_SIZE);
+        health.assign(cells, 1.0f);
+        age.assign(cells, 0.0f);
+    }
 
-    srand(time(0));
+    void addSeeds(int cell, float n) {
+        float total = count[cell] + n;
+        size[cell] = (size[cell] * count[cell] + SEED_SIZE * n) / total;
+        health[cell] = (health[cell] * count[cell] + n) / total;
+        age[cell] = age[cell] * count[cell] / total;
+        count[cell] = total;
+    }
 
-    std::vector<SoilCell> soil;
-    for(int z=0; z<GRID_SIZE; ++z)
-        for(int x=0; x<GRID_SIZE; ++x)
-            soil.push_back(SoilCell({(float)x,(float)z}));
+    // light and resource are per-cell inputs in [0,1]; returns the fastest per-tick change.
+    float step(const std::vector<float> &light, const std::vector<float> &resource,
+               std::vector<SoilCell> &soil, float dt) {
+        size_t cells = count.size(), i = 0;
+        uptake.resize(cells);
+        float *n = count.data(), *sz = size.data(), *h = health.data(), *a = age.data(), *up = uptake.data();
+        const float *l = light.data(), *r = resource.data();
 
-    std::vector<Plant> plants;
-    for(int i=0; i<NUM_PLANTS; ++i) {
-        Vector3 pos = {(float)(rand()%GRID_SIZE - GRID_SIZE/2), 0.5f, (float)(rand()%GRID_SIZE - GRID_SIZE/2)};
-        float growthRate = 0.02f + (rand()%10)/1000.0f;
-        plants.push_back(Plant(i, pos, 1.0f, growthRate));
+        // Branch-free pass over the flat cohort arrays. Mortality uses the implicit-Euler decay
+        // 1/(1+m*dt) in place of exp(-m*dt) so both paths stay free of libm calls.
+#if defined(__SSE2__)
+        const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f), vdt = _mm_set1_ps(dt);
+        const __m128 growthDt = _mm_set1_ps(0.0004f * dt), stressDt = _mm_set1_ps(0.0005f * dt);
+        const __m128 ageDt = _mm_set1_ps(0.01f * dt), cutoff = _mm_set1_ps(0.01f);
+        for(; i + 4 <= cells; i += 4) {
+            __m128 n0 = _mm_loadu_ps(n + i), li = _mm_loadu_ps(l + i);
+            __m128 occupied = _mm_cmpgt_ps(n0, zero);
+            __m128 lr = _mm_mul_ps(li, _mm_loadu_ps(r + i));
+            __m128 growth = _mm_mul_ps(growthDt, lr);
+            __m128 mortality = _mm_add_ps(_mm_set1_ps(0.002f), _mm_mul_ps(_mm_set1_ps(0.004f), _mm_sub_ps(one, li)));
+
+            _mm_storeu_ps(sz + i, _mm_add_ps(_mm_loadu_ps(sz + i), _mm_and_ps(occupied, growth)));
+            __m128 hi = _mm_max_ps(zero, _mm_sub_ps(_mm_loadu_ps(h + i), _mm_mul_ps(_mm_sub_ps(one, lr), stressDt)));
+            _mm_storeu_ps(h + i, hi);
+            _mm_storeu_ps(a + i, _mm_add_ps(_mm_loadu_ps(a + i), _mm_and_ps(occupied, ageDt)));
+            __m128 ni = _mm_div_ps(n0, _mm_add_ps(one, _mm_mul_ps(mortality, vdt)));
+            ni = _mm_and_ps(ni, _mm_cmpgt_ps(hi, zero));
+            ni = _mm_andnot_ps(_mm_cmplt_ps(ni, cutoff), ni);
+            _mm_storeu_ps(n + i, ni);
+            _mm_storeu_ps(up + i, _mm_mul_ps(_mm_mul_ps(ni, growth), _mm_set1_ps(0.001f)));
+        }
+#endif
+        for(; i < cells; i++) {
+            float occupied = n[i] > 0.0f ? 1.0f : 0.0f;
+            float lr = l[i] * r[i];
+            float growth = 0.0004f * dt * lr;
+            float mortality = 0.002f + 0.004f * (1.0f - l[i]);
+
+            sz[i] += growth * occupied;
+            float hi = std::max(0.0f, h[i] - (1.0f - lr) * (0.0005f * dt));
+            h[i] = hi;
+            a[i] += 0.01f * dt * occupied;
+            float ni = n[i] / (1.0f + mortality * dt) * (hi > 0.0f ? 1.0f : 0.0f);
+            n[i] = ni < 0.01f ? 0.0f : ni;
+            up[i] = n[i] * growth * 0.001f;
+        }
+
+        // Soil is array-of-structs, so its read-modify-write stays in its own scalar pass.
+        float maxRate = 0.0f;
+        for(size_t i = 0; i < cells; i++) {
+            if(n[i] <= 0.0f) continue;
+            soil[i].water = std::max(0.0f, soil[i].water - up[i]);
+            soil[i].nitrogen = std::max(0.0f, soil[i].nitrogen - up[i]);
+            soil[i].phosphorus = std::max(0.0f, soil[i].phosphorus - up[i]);
+            soil[i].potassium = std::max(0.0f, soil[i].potassium - up[i]);
+            maxRate = std::max(maxRate, 0.0004f * l[i] * r[i]);
+        }
+        return maxRate;
     }
 
-    std::ofstream plantLog("plant_growth.csv");
-    plantLog << "Frame,PlantID,X,Y,Z,Age,Size,Health,Alive\n";
+    float total() const {
+        float t = 0.0f;
+        for(float n : count) t += n;
+        return t;
+    }
+};
 
-    std::ofstream soilLog("soil_status.csv");
-    soilLog << "Frame,SoilX,SoilZ,Water,Nitrogen,Phosphorus,Potassium,Occupancy,PlantUsage\n";
+// ---------- Binary Serialization ----------
+template<typename T> void writeRaw(std::ostream &out, const T &v) { out.write((const char*)&v, sizeof(T)); }
+template<typename T> void readRaw(std::istream &in, T &v) { in.read((char*)&v, sizeof(T)); }
 
-    int frame = 0;
+template<typename T> void writeVector(std::ostream &out, const std::vector<T> &v) {
+    static_assert(std::is_trivially_copyable<T>::value, "raw vector I/O needs trivially copyable elements");
+    uint64_t n = v.size();
+    writeRaw(out, n);
+    out.write((const char*)v.data(), n * sizeof(T));
+}
+template<typename T> void readVector(std::istream &in, std::vector<T> &v) {
+    uint64_t n = 0;
+    readRaw(in, n);
+    v.resize(n);
+    in.read((char*)v.data(), n * sizeof(T));
+}
 
-    while(!WindowShouldClose()) {
-        float speed = 10.0f * GetFrameTime();
-        if(IsKeyDown(KEY_W)) camera.position = Vector3Add(camera.position, (Vector3){0,0,-speed});
-        if(IsKeyDown(KEY_S)) camera.position = Vector3Add(camera.position, (Vector3){0,0,speed});
-        if(IsKeyDown(KEY_A)) camera.position = Vector3Add(camera.position, (Vector3){-speed,0,0});
-        if(IsKeyDown(KEY_D)) camera.position = Vector3Add(camera.position, (Vector3){speed,0,0});
-        if(IsKeyDown(KEY_SPACE)) camera.position = Vector3Add(camera.position, (Vector3){0,speed,0});
-        if(IsKeyDown(KEY_LEFT_CONTROL)) camera.position = Vector3Add(camera.position, (Vector3){0,-speed,0});
+// ---------- Parallel Loops ----------
+// Splits [0, n) into contiguous ranges over the hardware threads; small loops run inline because
+// starting threads would cost more than the work.
+template<typename F> void parallelRanges(int n, int minPerThread, F fn) {
+    int threads = (int)std::min<unsigned>(std::max(1u, std::thread::hardware_concurrency()),
+                                          (unsigned)std::max(1, n / std::max(1, minPerThread)));
+    if(threads <= 1) { fn(0, n); return; }
+    std::vector<std::thread> workers;
+    for(int t = 1; t < threads; t++)
+        workers.emplace_back(fn, (int)((long long)n * t / threads), (int)((long long)n * (t + 1) / threads));
+    fn(0, n / threads);
+    for(auto &w : workers) w.join();
+}
 
-        camera.target = (Vector3){0,0,0};
+// ---------- Root Competition ----------
+// Zone-of-influence model: every soil cell belongs to the one living plant with the smallest
+// size-weighted distance (distance / size) among those whose roots reach it, and a plant takes
+// up water and nutrients only from its own cells. Ownership is found by jump flooding: seed each
+// plant's cell, then for step k = N/2 ... 1 let every cell adopt the best owner among the cells k
+// away, which is O(cells log cells) however densely the plants overlap.
+struct RootZones {
+    static constexpr float ROOT_REACH = 1.0f;  // root radius as a multiple of plant size
 
-        std::map<int,std::map<int,float>> nutrientUsed;
-        std::map<int,std::vector<std::pair<int,float>>> cellUsage;
+    std::vector<int> owner, next;         // plant index per cell, -1 when unclaimed
+    std::vector<std::vector<int>> cells;  // owned cells per plant index
 
-        for(auto &p : plants)
-            p.grow(soil, GRID_SIZE, CELL_SIZE, plants, nutrientUsed, cellUsage, HEIGHT_SCALE);
+    static float weightedDistance(const Plant &p, float cx, float cz, float cellSize) {
+        float dx = cx - p.position.x, dz = cz - p.position.z;
+        float dist = std::sqrt(dx*dx + dz*dz);
+        if(dist > std::max(p.size * ROOT_REACH, cellSize)) return INFINITY;
+        return dist / p.size;
+    }
 
-        BeginDrawing();
-            ClearBackground(RAYWHITE);
-            BeginMode3D(camera);
+    void assign(const std::vector<Plant> &plants, int gridSize, float cellSize) {
+        int cellCount = gridSize * gridSize;
+        owner.assign(cellCount, -1);
+        next.resize(cellCount);
+        auto center = [&](int idx, float &cx, float &cz) {
+            cx = (idx % gridSize) * cellSize + cellSize/2 - gridSize/2;
+            cz = (idx / gridSize) * cellSize + cellSize/2 - gridSize/2;
+        };
 
-                for(auto &s : soil)
-                    DrawCube({s.position.x - GRID_SIZE/2 + 0.5f, 0, s.position.y - GRID_SIZE/2 + 0.5f},
-                             CELL_SIZE, 0.2f, CELL_SIZE, (Color){139,69,19,255});
+        for(int i = 0; i < (int)plants.size(); i++) {
+            const Plant &p = plants[i];
+            if(!p.alive) continue;
+            // Clamped like World::cellAt: grow() keeps plants on [-gridSize/2, gridSize/2], and the +edge
+            // would otherwise index one past the grid.
+            int x = std::max(0, std::min(gridSize - 1, (int)((p.position.x + gridSize/2) / cellSize)));
+            int z = std::max(0, std::min(gridSize - 1, (int)((p.position.z + gridSize/2) / cellSize)));
+            int idx = z * gridSize + x;
+            float cx, cz;
+            center(idx, cx, cz);
+            if(owner[idx] < 0 || weightedDistance(p, cx, cz, cellSize) < weightedDistance(plants[owner[idx]], cx, cz, cellSize))
+                owner[idx] = i;
+        }
 
-                for(auto &p : plants)
-                    if(p.alive) {
-                        DrawCube(p.position, p.size, p.size, p.size, p.color);
-                        DrawCubeWires(p.position, p.size, p.size, p.size, BLACK);
+        std::vector<int> steps;
+        for(int k = 1; k < gridSize; k *= 2) steps.insert(steps.begin(), k);
+        steps.push_back(1);  // one extra unit pass repairs most jump-flooding misassignments
+        for(int k : steps) {
+            parallelRanges(gridSize, 64, [&](int zBegin, int zEnd) {
+                for(int z = zBegin; z < zEnd; z++)
+                    for(int x = 0; x < gridSize; x++) {
+                        int idx = z * gridSize + x;
+                        float cx, cz;
+                        center(idx, cx, cz);
+                        int best = owner[idx];
+                        float bestDist = best >= 0 ? weightedDistance(plants[best], cx, cz, cellSize) : INFINITY;
+                        for(int dz = -k; dz <= k; dz += k)
+                            for(int dx = -k; dx <= k; dx += k) {
+                                int nx = x + dx, nz = z + dz;
+                                if(nx < 0 || nx >= gridSize || nz < 0 || nz >= gridSize) continue;
+                                int candidate = owner[nz * gridSize + nx];
+                                if(candidate < 0 || candidate == best) continue;
+                                float d = weightedDistance(plants[candidate], cx, cz, cellSize);
+                                if(d < bestDist) { best = candidate; bestDist = d; }
+                            }
+                        next[idx] = bestDist < INFINITY ? best : -1;
                     }
+            });
+            owner.swap(next);
+        }
 
-            EndMode3D();
+        cells.assign(plants.size(), std::vector<int>());
+        for(int idx = 0; idx < cellCount; idx++)
+            if(owner[idx] >= 0) cells[owner[idx]].push_back(idx);
+    }
+};
 
-            DrawText("Use WASD + Space/CTRL to move.",10,10,20,DARKGRAY);
-            DrawText(TextFormat("Plants alive: %d", (int)std::count_if(plants.begin(), plants.end(),
-                        [](Plant &p){ return p.alive; })),10,40,20,DARKGREEN);
+// ---------- Soil Kinetics ----------
+// Per-cell chemistry as a small ODE system (rates per tick):
+//   water'   = rain - evaporation*W
+//   organic' = litter - mineralization*W*O
+//   N'       = nitrogenShare*M + fixation*(1 - N) - leaching*W*N      with M = mineralization*W*O
+//   P'       = phosphorusShare*M - sorption*P
+//   K'       = weathering - leaching*W*K
+// Integrated IMEX: sources explicit, the linear losses implicit, so a step of any length stays
+// positive and stable. SoilCell is an array of structs for the rest of the model, so each
+// cache-sized tile is transposed into per-channel arrays, advanced branch-free, and written back.
+struct SoilKinetics {
+    static constexpr int TILE = 1024;  // 5 channels x 4 KB = 20 KB stays resident in L1/L2
 
-        EndDrawing();
+    float rain = 0.0003f;
+    float evaporation = 0.0004f;
+    float litter = 0.0001f;
+    float mineralization = 0.0002f;
+    float nitrogenShare = 0.3f;
+    float phosphorusShare = 0.5f;
+    float fixation = 0.0001f;
+    float leaching = 0.0001f;
+    float sorption = 0.0001f;
+    float weathering = 0.00005f;
+
+    struct alignas(64) Tile {
+        float water[TILE], organic[TILE], nitrogen[TILE], phosphorus[TILE], potassium[TILE];
+    };
+
+    // Advances the first n cells of a tile in place (lanes up to the next multiple of four must hold
+    // finite values); returns the largest per-tick change of water, N, P or K.
+    float advance(Tile &t, int n, float dt) const {
+#if defined(__SSE2__)
+        const __m128 one = _mm_set1_ps(1.0f), vdt = _mm_set1_ps(dt);
+        const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+        const __m128 rainDt = _mm_set1_ps(dt * rain), evapInv = _mm_set1_ps(1.0f / (1.0f + dt * evaporation));
+        const __m128 litterDt = _mm_set1_ps(dt * litter), minDt = _mm_set1_ps(dt * mineralization);
+        const __m128 minRate = _mm_set1_ps(mineralization), nShare = _mm_set1_ps(nitrogenShare);
+        const __m128 pShareDt = _mm_set1_ps(dt * phosphorusShare), fix = _mm_set1_ps(fixation);
+        const __m128 leachDt = _mm_set1_ps(dt * leaching), fixDt = _mm_set1_ps(dt * fixation);
+        const __m128 sorbInv = _mm_set1_ps(1.0f / (1.0f + dt * sorption)), weatherDt = _mm_set1_ps(dt * weathering);
+        __m128 maxChange = _mm_setzero_ps();
+        for(int i = 0; i < n; i += 4) {
+            __m128 w0 = _mm_load_ps(t.water + i), o0 = _mm_load_ps(t.organic + i);
+            __m128 n0 = _mm_load_ps(t.nitrogen + i), p0 = _mm_load_ps(t.phosphorus + i), k0 = _mm_load_ps(t.potassium + i);
+
+            __m128 w = _mm_mul_ps(_mm_add_ps(w0, rainDt), evapInv);
+            __m128 o = _mm_div_ps(_mm_add_ps(o0, litterDt), _mm_add_ps(one, _mm_mul_ps(minDt, w)));
+            __m128 m = _mm_mul_ps(minRate, _mm_mul_ps(w, o));
+            __m128 leach = _mm_add_ps(one, _mm_mul_ps(leachDt, w));
+            __m128 nN = _mm_div_ps(_mm_add_ps(n0, _mm_mul_ps(vdt, _mm_add_ps(_mm_mul_ps(nShare, m), fix))),
+                                   _mm_add_ps(leach, fixDt));
+            __m128 nP = _mm_mul_ps(_mm_add_ps(p0, _mm_mul_ps(pShareDt, m)), sorbInv);
+            __m128 nK = _mm_div_ps(_mm_add_ps(k0, weatherDt), leach);
+
+            maxChange = _mm_max_ps(maxChange, _mm_and_ps(absMask, _mm_sub_ps(w, w0)));
+            maxChange = _mm_max_ps(maxChange, _mm_and_ps(absMask, _mm_sub_ps(nN, n0)));
+            maxChange = _mm_max_ps(maxChange, _mm_and_ps(absMask, _mm_sub_ps(nP, p0)));
+            maxChange = _mm_max_ps(maxChange, _mm_and_ps(absMask, _mm_sub_ps(nK, k0)));
+
+            _mm_store_ps(t.water + i, w); _mm_store_ps(t.organic + i, o); _mm_store_ps(t.nitrogen + i, nN);
+            _mm_store_ps(t.phosphorus + i, nP); _mm_store_ps(t.potassium + i, nK);
+        }
+        alignas(16) float lanes[4];
+        _mm_store_ps(lanes, maxChange);
+        return std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3])) / dt;
+#else
+        float evapInv = 1.0f / (1.0f + dt * evaporation), sorbInv = 1.0f / (1.0f + dt * sorption);
+        float maxChange = 0.0f;
+        for(int i = 0; i < n; i++) {
+            float w = (t.water[i] + dt * rain) * evapInv;
+            float o = (t.organic[i] + dt * litter) / (1.0f + dt * mineralization * w);
+            float m = mineralization * w * o;
+            float nN = (t.nitrogen[i] + dt * (nitrogenShare * m + fixation)) / (1.0f + dt * (fixation + leaching * w));
+            float nP = (t.phosphorus[i] + dt * phosphorusShare * m) * sorbInv;
+            float nK = (t.potassium[i] + dt * weathering) / (1.0f + dt * leaching * w);
+
+            maxChange = std::max(maxChange, std::fabs(w - t.water[i]));
+            maxChange = std::max(maxChange, std::fabs(nN - t.nitrogen[i]));
+            maxChange = std::max(maxChange, std::fabs(nP - t.phosphorus[i]));
+            maxChange = std::max(maxChange, std::fabs(nK - t.potassium[i]));
+
+            t.water[i] = w; t.organic[i] = o; t.nitrogen[i] = nN; t.phosphorus[i] = nP; t.potassium[i] = nK;
+        }
+        return maxChange / dt;
+#endif
+    }
+
+    float integrate(std::vector<SoilCell> &soil, float dt) const {
+        int tiles = ((int)soil.size() + TILE - 1) / TILE;
+        float maxRate = 0.0f;
+        std::mutex rateLock;
+
+        parallelRanges(tiles, 16, [&](int tBegin, int tEnd) {
+            std::unique_ptr<Tile> t(new Tile);
+            float localRate = 0.0f;
+            for(int tile = tBegin; tile < tEnd; tile++) {
+                int base = tile * TILE, n = std::min(TILE, (int)soil.size() - base);
+                for(int i = 0; i < n; i++) {
+                    const SoilCell &c = soil[base + i];
+                    t->water[i] = c.water; t->organic[i] = c.organic; t->nitrogen[i] = c.nitrogen;
+                    t->phosphorus[i] = c.phosphorus; t->potassium[i] = c.potassium;
+                }
+                for(int i = n; i < TILE && i % 4 != 0; i++)
+                    t->water[i] = t->organic[i] = t->nitrogen[i] = t->phosphorus[i] = t->potassium[i] = 0.0f;
+                localRate = std::max(localRate, advance(*t, n, dt));
+                for(int i = 0; i < n; i++) {
+                    SoilCell &c = soil[base + i];
+                    c.water = t->water[i]; c.organic = t->organic[i]; c.nitrogen = t->nitrogen[i];
+                    c.phosphorus = t->phosphorus[i]; c.potassium = t->potassium[i];
+                }
+            }
+            std::lock_guard<std::mutex> guard(rateLock);
+            maxRate = std::max(maxRate, localRate);
+        });
+        return maxRate;
+    }
+};
+
+// ---------- World ----------
+struct World {
+    int gridSize;
+    float cellSize;
+    float heightScale;
+    uint64_t seed = 1;
+    Rng rng;
+    std::vector<SoilCell> soil;
+    std::vector<Plant> plants;
+    SeedlingCohorts seedlings;
+    bool reproduction = true;
+    bool zoneOfInfluence = true;  // root uptake from jump-flooded zones instead of every overlapped cell
+    RootZones roots;
+    bool soilKinetics = true;     // mineralization, fixation and leaching between steps
+    SoilKinetics kinetics;
+    int nextPlantId = 0;
+
+    double time = 0.0;     // simulated time in baseline ticks (one fixed 0.01 age step); double so 1-tick steps still register past 2^24
+    float maxRate = 0.0f;  // fastest size/health/soil change per tick seen in the last step
+
+    std::map<int,std::map<int,float>> nutrientUsed;
+    std::map<int,std::vector<std::pair<int,float>>> cellUsage;
+
+    World() : gridSize(0), cellSize(1.0f), heightScale(1.0f) {}
+
+    World(int _gridSize, float _cellSize, float _heightScale, int numPlants, uint64_t _seed)
+        : gridSize(_gridSize), cellSize(_cellSize), heightScale(_heightScale), seed(_seed), rng(_seed) {
+        for(int z=0; z<gridSize; ++z)
+            for(int x=0; x<gridSize; ++x)
+                soil.push_back(SoilCell({(float)x,(float)z}, rng));
+
+        for(int i=0; i<numPlants; ++i) {
+            Vector3 pos = {(float)(rng()%gridSize - gridSize/2), 0.5f, (float)(rng()%gridSize - gridSize/2)};
+            float growthRate = 0.02f + (rng()%10)/1000.0f;
+            plants.push_back(Plant(nextPlantId++, pos, 1.0f, growthRate, rng));
+        }
+        seedlings.resize(gridSize * gridSize);
+    }
+
+    int cellAt(float x, float z) const {
+        int cx = std::max(0, std::min(gridSize - 1, (int)((x + gridSize/2) / cellSize)));
+        int cz = std::max(0, std::min(gridSize - 1, (int)((z + gridSize/2) / cellSize)));
+        return cz * gridSize + cx;
+    }
+
+    // Plants between 30% and 60% of their lifespan scatter seeds within twice their size.
+    void disperseSeeds(float dt) {
+        for(auto &p : plants) {
+            float agePerc = p.age / p.maxAge;
+            if(!p.alive || agePerc < 0.3f || agePerc > 0.6f) continue;
+            int seeds = (int)(0.01f * p.size * dt + (rng()%1000)/1000.0f);
+            for(int s = 0; s < seeds; s++) {
+                float angle = (rng()%628) / 100.0f;
+                float dist = (rng()%100) / 50.0f * p.size;
+                seedlings.addSeeds(cellAt(p.position.x + cosf(angle)*dist, p.position.z + sinf(angle)*dist), 1.0f);
+            }
+        }
+    }
 
+    float stepSeedlings(float dt) {
+        std::vector<float> light(soil.size(), 1.0f), resource(soil.size());
         for(auto &p : plants)
-            plantLog << frame << "," << p.id << "," << p.position.x << "," << p.position.y << "," << p.position.z << ","
-                     << p.age << "," << p.size << "," << p.health << "," << p.alive << "\n";
+            if(p.alive)
+                for(int idx : p.getOccupiedSoilIndices(gridSize, cellSize))
+                    light[idx] *= 0.8f;
+        for(size_t i = 0; i < soil.size(); i++)
+            resource[i] = (soil[i].nitrogen + soil[i].phosphorus + soil[i].potassium)/3.0f * soil[i].water;
+
+        float rate = seedlings.step(light, resource, soil, dt);
+
+        for(int i = 0; i < (int)soil.size(); i++) {
+            if(seedlings.count[i] <= 0.0f || seedlings.size[i] < SeedlingCohorts::PROMOTE_SIZE) continue;
+            int promoted = std::min(SeedlingCohorts::MAX_PROMOTED, (int)(seedlings.count[i] + (rng()%1000)/1000.0f));
+            for(int k = 0; k < promoted; k++) {
+                Vector3 pos = {soil[i].position.x - gridSize/2 + (rng()%100)/100.0f, 0.5f,
+                               soil[i].position.y - gridSize/2 + (rng()%100)/100.0f};
+                Plant child(nextPlantId++, pos, seedlings.size[i], 0.02f + (rng()%10)/1000.0f, rng);
+                child.health = seedlings.health[i];
+                child.age = seedlings.age[i];
+                plants.push_back(child);
+            }
+            seedlings.count[i] = 0.0f;
+            seedlings.size[i] = SeedlingCohorts::SEED_SIZE;
+        }
+        return rate;
+    }
+
+    void step(float dt) {
+        nutrientUsed.clear();
+        cellUsage.clear();
+
+        if(zoneOfInfluence) roots.assign(plants, gridSize, cellSize);
+
+        maxRate = 0.0f;
+        for(size_t i = 0; i < plants.size(); i++) {
+            Plant &p = plants[i];
+            float prevSize = p.size, prevHealth = p.health;
+            p.grow(soil, gridSize, cellSize, plants, nutrientUsed, cellUsage, heightScale, rng, dt,
+                   zoneOfInfluence ? &roots.cells[i] : nullptr);
+            if(!p.alive) continue;
+            maxRate = std::max(maxRate, std::fabs(p.size - prevSize) / dt);
+            maxRate = std::max(maxRate, std::fabs(p.health - prevHealth) / dt);
+        }
 
         for(auto &[idx, usageList] : cellUsage) {
+            float used = 0.0f;
+            for(auto &[plantId, amount] : usageList) used += amount;
+            maxRate = std::max(maxRate, used * 0.001f / dt);
+        }
+
+        if(reproduction) {
+            disperseSeeds(dt);
+            maxRate = std::max(maxRate, stepSeedlings(dt));
+        }
+
+        if(soilKinetics) maxRate = std::max(maxRate, kinetics.integrate(soil, dt));
+
+        time += dt;
+    }
+
+    // Takes the given fraction of every seedling cohort out of this world; returns the seeds removed.
+    float emigrate(float fraction) {
+        float removed = 0.0f;
+        for(auto &n : seedlings.count) {
+            removed += n * fraction;
+            n -= n * fraction;
+        }
+        return removed;
+    }
+
+    // Scatters arriving seeds over random cells (fractional seeds are rounded stochastically).
+    void immigrate(float seeds) {
+        int whole = (int)(seeds + (rng()%1000)/1000.0f);
+        for(int s = 0; s < whole; s++)
+            seedlings.addSeeds(rng() % (int)soil.size(), 1.0f);
+    }
+
+    // External intervention: spread fertilizer evenly over every cell.
+    void fertilize(float amount) {
+        for(auto &c : soil) {
+            c.nitrogen = std::min(1.0f, c.nitrogen + amount);
+            c.phosphorus = std::min(1.0f, c.phosphorus + amount);
+            c.potassium = std::min(1.0f, c.potassium + amount);
+        }
+    }
+
+    // Everything the deterministic update depends on; per-step scratch maps are not included.
+    void save(std::ostream &out) const {
+        writeRaw(out, gridSize); writeRaw(out, cellSize); writeRaw(out, heightScale);
+        writeRaw(out, seed); writeRaw(out, rng.state);
+        writeRaw(out, reproduction); writeRaw(out, zoneOfInfluence);
+        writeRaw(out, soilKinetics); writeRaw(out, nextPlantId);
+        writeRaw(out, time); writeRaw(out, maxRate);
+        writeVector(out, soil);
+        writeVector(out, plants);
+        writeVector(out, seedlings.count); writeVector(out, seedlings.size);
+        writeVector(out, seedlings.health); writeVector(out, seedlings.age);
+    }
+
+    void load(std::istream &in) {
+        readRaw(in, gridSize); readRaw(in, cellSize); readRaw(in, heightScale);
+        readRaw(in, seed); readRaw(in, rng.state);
+        readRaw(in, reproduction); readRaw(in, zoneOfInfluence);
+        readRaw(in, soilKinetics); readRaw(in, nextPlantId);
+        readRaw(in, time); readRaw(in, maxRate);
+        readVector(in, soil);
+        readVector(in, plants);
+        readVector(in, seedlings.count); readVector(in, seedlings.size);
+        readVector(in, seedlings.health); readVector(in, seedlings.age);
+    }
+
+    // Drops dead plants. They no longer take part in any update, so this does not change the dynamics.
+    void compact() {
+        plants.erase(std::remove_if(plants.begin(), plants.end(), [](const Plant &p){ return !p.alive; }), plants.end());
+    }
+
+    // Puts the listed plant ids first, in that order; plants not listed keep their relative order after them.
+    void reorder(const std::vector<int32_t> &ids) {
+        std::map<int,size_t> position;
+        for(size_t i = 0; i < plants.size(); i++) position[plants[i].id] = i;
+        std::vector<Plant> sorted;
+        std::vector<bool> taken(plants.size(), false);
+        for(int32_t id : ids) {
+            auto it = position.find(id);
+            if(it == position.end() || taken[it->second]) continue;
+            sorted.push_back(plants[it->second]);
+            taken[it->second] = true;
+        }
+        for(size_t i = 0; i < plants.size(); i++)
+            if(!taken[i]) sorted.push_back(plants[i]);
+        plants.swap(sorted);
+    }
+
+    int aliveCount() const {
+        return (int)std::count_if(plants.begin(), plants.end(), [](const Plant &p){ return p.alive; });
+    }
+};
+
+// ---------- Adaptive Time Stepping ----------
+// Age fractions at which Plant::grow switches growth regime (plus death at maxAge).
+const float AGE_PHASES[] = {0.25f, 0.3f, 0.5f, 0.6f, 1.0f};
+
+struct StepController {
+    float tolerance = 0.002f;  // largest change of any size/health/soil value allowed per step
+    float minDt = 1.0f;
+    float maxDt = 50.0f;
+    float growth = 2.0f;       // max factor the step may lengthen by between steps
+    float lastDt = 1.0f;
+
+    // Step length in ticks: bounded by the last observed change rate, then cut so that no plant
+    // crosses more than one tick past an age-phase boundary and the step ends by untilTime.
+    float choose(const World &world, double untilTime = INFINITY) {
+        float dt = world.maxRate > 0.0f ? tolerance / world.maxRate : maxDt;
+        dt = std::min(dt, lastDt * growth);
+        dt = std::max(minDt, std::min(dt, maxDt));
+
+        for(auto &p : world.plants) {
+            if(!p.alive) continue;
+            for(float phase : AGE_PHASES) {
+                float ticksLeft = (phase * p.maxAge - p.age) / 0.01f;
+                if(ticksLeft <= 0.0f) continue;
+                dt = std::min(dt, std::max(minDt, std::ceil(ticksLeft)));
+                break;
+            }
+        }
+
+        double toEvent = untilTime - world.time;
+        if(toEvent > 0.0) dt = (float)std::min((double)dt, toEvent);
+
+        lastDt = dt;
+        return dt;
+    }
+};
+
+// ---------- Event-Sourced Plant Log ----------
+// Instead of every plant on every frame, the log holds the run seed, births (full attributes),
+// deaths, age-phase transitions, external interventions and a periodic keyframe of the whole
+// world. Any frame is reconstructed by loading the nearest earlier keyframe and re-running the
+// deterministic update with the logged interventions applied.
+enum EventType : uint8_t { EV_BIRTH = 1, EV_DEATH, EV_PHASE, EV_INTERVENTION, EV_KEYFRAME, EV_COMPACT, EV_REORDER, EV_END };
+enum InterventionKind : int32_t { INTERVENE_FERTILIZE = 1 };
+
+const char EVENT_LOG_MAGIC[8] = {'E','C','O','E','V','T','1','\0'};
+
+int agePhase(const Plant &p) {
+    int phase = 0;
+    for(float boundary : AGE_PHASES)
+        if(p.age / p.maxAge > boundary) phase++;
+    return phase;
+}
+
+void applyIntervention(World &world, int32_t kind, float amount) {
+    if(kind == INTERVENE_FERTILIZE) world.fertilize(amount);
+}
+
+struct EventLog {
+    std::ofstream out;
+    std::map<int,std::pair<bool,int>> known;  // live plant id -> (alive, phase) as last observed
+    int32_t unseenId = 0;                       // plant ids below this have been logged already
+
+    EventLog(const char *path, const World &world) : out(path, std::ios::binary) {
+        out.write(EVENT_LOG_MAGIC, sizeof(EVENT_LOG_MAGIC));
+        writeRaw(out, world.seed);
+    }
+
+    void header(uint8_t type, int32_t frame) {
+        writeRaw(out, type);
+        writeRaw(out, frame);
+    }
+
+    // Keyframe taken at the start of a frame, before its interventions and step.
+    void keyframe(const World &world, const StepController &controller, int32_t frame) {
+        std::ostringstream blob(std::ios::binary);
+        writeRaw(blob, controller.lastDt);
+        world.save(blob);
+        std::string bytes = blob.str();
+
+        header(EV_KEYFRAME, frame);
+        uint64_t length = bytes.size();
+        writeRaw(out, length);
+        out.write(bytes.data(), length);
+    }
+
+    void intervention(int32_t frame, int32_t kind, float amount) {
+        header(EV_INTERVENTION, frame);
+        writeRaw(out, kind);
+        writeRaw(out, amount);
+    }
+
+    // Plant list edits made by background passes; the update order matters for replay.
+    void compaction(int32_t frame) {
+        header(EV_COMPACT, frame);
+    }
+
+    void reorder(int32_t frame, const std::vector<int32_t> &ids) {
+        header(EV_REORDER, frame);
+        writeVector(out, ids);
+    }
+
+    // Marks the last frame that was stepped, so replay knows where the log stops.
+    void finish(int32_t frame) {
+        header(EV_END, frame);
+        out.close();
+    }
+
+    // Diffs the plant list against what was seen last and records births, deaths and phase changes.
+    void observe(const World &world, int32_t frame) {
+        // Ids only grow, so an unknown id below unseenId is a plant whose death was already logged.
+        int32_t firstNew = unseenId;
+        for(auto &p : world.plants) {
+            int phase = agePhase(p);
+            auto it = known.find(p.id);
+            if(it == known.end()) {
+                if(p.id < firstNew) continue;
+                header(EV_BIRTH, frame);
+                writeRaw(out, p);
+                if(p.alive) known[p.id] = {p.alive, phase};
+                unseenId = std::max(unseenId, (int32_t)p.id + 1);
+                continue;
+            }
+            if(!p.alive) {
+                header(EV_DEATH, frame);
+                writeRaw(out, (int32_t)p.id);
+                known.erase(it);
+                continue;
+            }
+            if(it->second.second != phase) {
+                header(EV_PHASE, frame);
+                writeRaw(out, (int32_t)p.id);
+                writeRaw(out, (int32_t)phase);
+            }
+            it->second = {p.alive, phase};
+        }
+    }
+};
+
+// ---------- Background Analyses ----------
+// Passes too slow for one frame are written as resumable jobs: each takes a snapshot of what it
+// reads when created, then does a bounded slice of work per call. The frame loop hands them only
+// the time left over in the frame budget, so an analysis is spread across frames instead of
+// causing a hitch. Jobs that edit the world do so in commit(), once, on the main thread. A commit
+// that changes the dynamics must not depend on how much time frames happened to leave over, so such
+// jobs carry a due frame: they commit exactly then, finishing any remaining work synchronously.
+const int BACKGROUND_SLICE_CELLS = 4096;
+
+struct BackgroundJob {
+    int dueFrame = -1;  // frame to commit on; -1 commits as soon as the job finishes
+    virtual ~BackgroundJob() {}
+    // Does a bounded amount of work; returns true once finished.
+    virtual bool runSlice() = 0;
+    virtual void commit(World &, EventLog &, int) {}
+};
+
+struct BackgroundResults {
+    float nitrogenMoran = NAN;  // Moran's I of soil nitrogen, rook neighbours
+    int depletedPatches = -1;
+    int largestPatch = 0;
+};
+
+// Moran's I of nitrogen: one pass for the mean, one for the cross products.
+struct SpatialStatsJob : BackgroundJob {
+    std::vector<float> values;
+    int gridSize;
+    BackgroundResults &results;
+    int phase = 0, next = 0;
+    double mean = 0.0, cross = 0.0, variance = 0.0, weights = 0.0;
+
+    SpatialStatsJob(const World &world, BackgroundResults &_results) : gridSize(world.gridSize), results(_results) {
+        values.reserve(world.soil.size());
+        for(auto &c : world.soil) values.push_back(c.nitrogen);
+    }
+
+    bool runSlice() override {
+        int n = (int)values.size(), end = std::min(n, next + BACKGROUND_SLICE_CELLS);
+        if(phase == 0) {
+            for(; next < end; next++) mean += values[next];
+            if(next == n) { mean /= n; phase = 1; next = 0; }
+            return false;
+        }
+        for(; next < end; next++) {
+            double d = values[next] - mean;
+            variance += d * d;
+            int x = next % gridSize, z = next / gridSize;
+            if(x + 1 < gridSize) { cross += 2.0 * d * (values[next + 1] - mean); weights += 2.0; }
+            if(z + 1 < gridSize) { cross += 2.0 * d * (values[next + gridSize] - mean); weights += 2.0; }
+        }
+        if(next < n) return false;
+        results.nitrogenMoran = variance > 0.0 && weights > 0.0 ? (float)(n / weights * cross / variance) : 0.0f;
+        return true;
+    }
+};
+
+// Connected patches of nitrogen-depleted cells: union-find over the rows, then one counting pass.
+struct PatchLabelJob : BackgroundJob {
+    static constexpr float DEPLETED = 0.3f;
+
+    std::vector<bool> depleted;
+    std::vector<int> parent, size;
+    int gridSize;
+    BackgroundResults &results;
+    int phase = 0, next = 0, patches = 0, largest = 0;
+
+    PatchLabelJob(const World &world, BackgroundResults &_results) : gridSize(world.gridSize), results(_results) {
+        for(auto &c : world.soil) depleted.push_back(c.nitrogen < DEPLETED);
+        parent.resize(depleted.size());
+        size.assign(depleted.size(), 0);
+        for(size_t i = 0; i < parent.size(); i++) parent[i] = (int)i;
+    }
+
+    int find(int i) {
+        while(parent[i] != i) { parent[i] = parent[parent[i]]; i = parent[i]; }
+        return i;
+    }
+
+    bool runSlice() override {
+        int n = (int)depleted.size(), end = std::min(n, next + BACKGROUND_SLICE_CELLS);
+        if(phase == 0) {
+            for(; next < end; next++) {
+                if(!depleted[next]) continue;
+                int x = next % gridSize;
+                if(x > 0 && depleted[next - 1]) parent[find(next)] = find(next - 1);
+                if(next >= gridSize && depleted[next - gridSize]) parent[find(next)] = find(next - gridSize);
+            }
+            if(next == n) { phase = 1; next = 0; }
+            return false;
+        }
+        for(; next < end; next++) {
+            if(!depleted[next]) continue;
+            int root = find(next);
+            if(size[root]++ == 0) patches++;
+            largest = std::max(largest, size[root]);
+        }
+        if(next < n) return false;
+        results.depletedPatches = patches;
+        results.largestPatch = largest;
+        return true;
+    }
+};
+
+// Drops dead plants from the world; deciding is cheap, so the job only waits for its turn.
+struct CompactionJob : BackgroundJob {
+    bool runSlice() override { return true; }
+    void commit(World &world, EventLog &events, int frame) override {
+        world.compact();
+        events.compaction(frame);
+    }
+};
+
+// Sorts plants by soil cell so neighbours sit together in memory; resumable bottom-up merge sort
+// over a snapshot of (cell, id) keys. Plants born meanwhile are kept after the sorted ones. The
+// merge cursor survives between slices, so one slice moves at most BACKGROUND_SLICE_CELLS keys
+// however wide the current merge is. Storage order feeds the update order, so the reorder is due
+// at a fixed frame.
+struct SpatialSortJob : BackgroundJob {
+    std::vector<std::pair<int,int32_t>> keys, scratch;
+    size_t width = 1, pos = 0;
+    size_t left = 0, right = 0, out = 0;  // cursors into the pair being merged
+
+    SpatialSortJob(const World &world, int due) {
+        for(auto &p : world.plants)
+            if(p.alive) keys.push_back({world.cellAt(p.position.x, p.position.z), p.id});
+        scratch.resize(keys.size());
+        right = std::min(width, keys.size());
+        dueFrame = due;
+    }
+
+    bool runSlice() override {
+        size_t n = keys.size(), budget = BACKGROUND_SLICE_CELLS;
+        while(width < n && budget > 0) {
+            size_t mid = std::min(pos + width, n), end = std::min(pos + 2 * width, n);
+            for(; out < end && budget > 0; out++, budget--)
+                scratch[out] = right >= end || (left < mid && !(keys[right] < keys[left])) ? keys[left++] : keys[right++];
+            if(out < end) break;
+            pos = end;
+            if(pos >= n) {
+                keys.swap(scratch);
+                width *= 2;
+                pos = 0;
+            }
+            left = out = pos;
+            right = std::min(pos + width, n);
+        }
+        return width >= n;
+    }
+
+    void commit(World &world, EventLog &events, int frame) override {
+        std::vector<int32_t> ids;
+        for(auto &k : keys) ids.push_back(k.second);
+        world.reorder(ids);
+        events.reorder(frame, ids);
+    }
+};
+
+struct BackgroundScheduler {
+    std::deque<std::unique_ptr<BackgroundJob>> jobs;
+    std::vector<std::unique_ptr<BackgroundJob>> parked;  // finished, waiting for their due frame
+
+    void add(BackgroundJob *job) { jobs.emplace_back(job); }
+
+    // Commits jobs due this frame, then runs slices round-robin until the budget is spent (always at
+    // least one, so work progresses).
+    void run(double budgetSeconds, World &world, EventLog &events, int frame) {
+        auto due = [frame](const std::unique_ptr<BackgroundJob> &job) { return job->dueFrame == frame; };
+        for(auto it = parked.begin(); it != parked.end(); ) {
+            if(!due(*it)) { ++it; continue; }
+            (*it)->commit(world, events, frame);
+            it = parked.erase(it);
+        }
+        for(auto it = jobs.begin(); it != jobs.end(); ) {
+            if(!due(*it)) { ++it; continue; }
+            while(!(*it)->runSlice()) {}
+            (*it)->commit(world, events, frame);
+            it = jobs.erase(it);
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        do {
+            if(jobs.empty()) return;
+            std::unique_ptr<BackgroundJob> job = std::move(jobs.front());
+            jobs.pop_front();
+            if(!job->runSlice()) jobs.push_back(std::move(job));
+            else if(job->dueFrame < 0) job->commit(world, events, frame);
+            else parked.push_back(std::move(job));
+        } while(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() < budgetSeconds);
+    }
+};
+
+// Rolling frame-time percentile for the HUD.
+struct FrameTimer {
+    std::vector<float> samples = std::vector<float>(600, 0.0f);
+    size_t next = 0;
+
+    void add(float seconds) { samples[next++ % samples.size()] = seconds; }
+
+    float percentile(float q) const {
+        std::vector<float> sorted(samples.begin(), samples.begin() + std::min(next, samples.size()));
+        if(sorted.empty()) return 0.0f;
+        size_t k = std::min(sorted.size() - 1, (size_t)(q * sorted.size()));
+        std::nth_element(sorted.begin(), sorted.begin() + k, sorted.end());
+        return sorted[k];
+    }
+};
+
+// ---------- Metric Pyramids ----------
+// Multi-resolution summary of one metric over the whole run. Level L holds buckets of FANOUT^L
+// consecutive samples (min, max, sum, count); every FANOUT closed buckets of one level close one
+// bucket of the next, so appending is O(1) amortized. Each level keeps its newest
+// MAX_BUCKETS_PER_LEVEL buckets (96 KB), about 1 MB per metric at 10^8 samples, while any zoom
+// level still reads at most a few hundred precomputed buckets.
+struct MetricBucket {
+    float min = INFINITY, max = -INFINITY;
+    double sum = 0.0;
+    uint64_t count = 0;
+
+    void merge(const MetricBucket &o) {
+        min = std::min(min, o.min); max = std::max(max, o.max);
+        sum += o.sum; count += o.count;
+    }
+    float mean() const { return count ? (float)(sum / count) : 0.0f; }
+};
+
+struct MetricPyramid {
+    static constexpr int FANOUT = 4;
+    static constexpr size_t MAX_BUCKETS_PER_LEVEL = 1 << 12;
+
+    struct Level {
+        std::vector<MetricBucket> ring;  // closed buckets, ring buffer of the newest ones
+        uint64_t closed = 0;             // buckets closed so far at this level
+        MetricBucket pending;            // being assembled from closed buckets of the level below
+        int pendingChildren = 0;
+    };
+
+    std::vector<Level> levels;
+    uint64_t samples = 0;
+
+    uint64_t span(size_t level) const {
+        uint64_t s = 1;
+        for(size_t i = 0; i < level; i++) s *= FANOUT;
+        return s;
+    }
+
+    void append(float v) {
+        MetricBucket b;
+        b.min = b.max = v; b.sum = v; b.count = 1;
+        push(0, b);
+        samples++;
+    }
+
+    void push(size_t level, const MetricBucket &b) {
+        if(level == levels.size()) levels.emplace_back();
+        Level &l = levels[level];
+        if(l.ring.size() < MAX_BUCKETS_PER_LEVEL) l.ring.push_back(b);
+        else l.ring[l.closed % MAX_BUCKETS_PER_LEVEL] = b;
+        l.closed++;
+
+        if(level + 1 == levels.size()) levels.emplace_back();
+        Level &up = levels[level + 1];
+        up.pending.merge(b);
+        if(++up.pendingChildren == FANOUT) {
+            MetricBucket full = up.pending;
+            up.pending = MetricBucket();
+            up.pendingChildren = 0;
+            push(level + 1, full);
+        }
+    }
+
+    // Summarizes samples [from, samples) in at most maxBuckets buckets, oldest first, using the finest
+    // level that still retains `from`. The last bucket includes samples not yet closed at that level.
+    std::vector<MetricBucket> query(uint64_t from, int maxBuckets) const {
+        std::vector<MetricBucket> out;
+        if(samples == 0 || from >= samples) return out;
+        for(size_t level = 0; level < levels.size(); level++) {
+            const Level &l = levels[level];
+            uint64_t s = span(level);
+            uint64_t oldest = l.closed > l.ring.size() ? l.closed - l.ring.size() : 0;
+            uint64_t first = from / s;
+            if((samples - from) / s + 1 > (uint64_t)maxBuckets && level + 1 < levels.size()) continue;
+            if(first < oldest && level + 1 < levels.size()) continue;
+
+            for(uint64_t b = std::max(first, oldest); b < l.closed; b++)
+                out.push_back(l.ring[b % MAX_BUCKETS_PER_LEVEL]);
+            MetricBucket tail;
+            for(size_t below = 1; below <= level; below++) tail.merge(levels[below].pending);
+            if(tail.count) out.push_back(tail);
+            return out;
+        }
+        return out;
+    }
+};
+
+// Live HUD chart of run-long metrics; Tab cycles the metric, -/= zoom out/in on the newest samples.
+// Steps cover anywhere from a fraction of a tick to dozens, so samples are resampled onto whole
+// ticks (each step's value held for the ticks it covered); buckets and means are then per tick.
+struct PopulationCharts {
+    static constexpr int METRICS = 5;
+    const char *names[METRICS] = {"Plants alive", "Mean plant size", "Total water", "Total nitrogen", "Seedlings"};
+    MetricPyramid pyramids[METRICS];
+    static constexpr uint64_t MIN_WINDOW = 200;
+    int selected = 0;
+    int zoom = 0;  // window = all samples >> (2 * zoom), at least MIN_WINDOW
+    double charted = 0.0;  // simulated time covered by the samples so far
+
+    // Stops once the window is at its floor, which also keeps the shift below 64 bits.
+    void zoomIn() {
+        if((pyramids[selected].samples >> (2 * zoom)) > MIN_WINDOW) zoom++;
+    }
+    void zoomOut() { zoom = std::max(0, zoom - 1); }
+
+    void sample(const World &world) {
+        float sizeSum = 0.0f;
+        int alive = 0;
+        for(auto &p : world.plants)
+            if(p.alive) { sizeSum += p.size; alive++; }
+        double water = 0.0, nitrogen = 0.0;
+        for(auto &c : world.soil) { water += c.water; nitrogen += c.nitrogen; }
+
+        float values[METRICS] = {(float)alive, alive ? sizeSum / alive : 0.0f, (float)water, (float)nitrogen,
+                                 world.seedlings.total()};
+        for(; charted + 1.0 <= world.time; charted += 1.0)
+            for(int i = 0; i < METRICS; i++) pyramids[i].append(values[i]);
+    }
+
+    void draw(int x, int y, int width, int height) const {
+        const MetricPyramid &m = pyramids[selected];
+        uint64_t window = std::max<uint64_t>(std::min<uint64_t>(m.samples, MIN_WINDOW), m.samples >> std::min(2 * zoom, 62));
+        auto buckets = m.query(m.samples - window, width / 2);
+
+        DrawRectangle(x, y, width, height, (Color){255,255,255,200});
+        DrawRectangleLines(x, y, width, height, GRAY);
+        DrawText(TextFormat("%s, last %llu ticks (Tab, -/=)", names[selected], (unsigned long long)window), x + 5, y + 5, 10, DARKGRAY);
+        if(buckets.empty()) return;
+
+        float lo = INFINITY, hi = -INFINITY;
+        for(auto &b : buckets) { lo = std::min(lo, b.min); hi = std::max(hi, b.max); }
+        if(hi - lo < 1e-6f) hi = lo + 1.0f;
+        DrawText(TextFormat("%.3g", hi), x + 5, y + 18, 10, GRAY);
+        DrawText(TextFormat("%.3g", lo), x + 5, y + height - 12, 10, GRAY);
+
+        int top = y + 20, plotHeight = height - 25;
+        auto toY = [&](float v) { return top + (int)((hi - v) / (hi - lo) * plotHeight); };
+        float column = (float)width / buckets.size();
+        for(size_t i = 0; i < buckets.size(); i++) {
+            int cx = x + (int)(i * column);
+            int yMax = toY(buckets[i].max), yMin = toY(buckets[i].min);
+            DrawRectangle(cx, yMax, std::max(1, (int)column), std::max(1, yMin - yMax), LIGHTGRAY);
+            if(i > 0) DrawLine(cx - (int)column, toY(buckets[i-1].mean()), cx, toY(buckets[i].mean()), DARKGREEN);
+        }
+    }
+};
+
+// Rebuilds one frame from an event log and prints it in the plant_growth.csv layout.
+int runReplay(const char *path, int targetFrame) {
+    std::ifstream in(path, std::ios::binary);
+    char magic[sizeof(EVENT_LOG_MAGIC)];
+    in.read(magic, sizeof(magic));
+    if(!in || memcmp(magic, EVENT_LOG_MAGIC, sizeof(magic)) != 0) {
+        fprintf(stderr, "%s: not an EcoSphere event log\n", path);
+        return 1;
+    }
+    uint64_t seed = 0;
+    readRaw(in, seed);
+
+    std::streamoff keyOffset = -1;
+    int32_t keyFrame = 0;
+    struct Action {
+        int32_t frame;
+        uint8_t type;
+        int32_t kind;
+        float amount;
+        std::vector<int32_t> ids;
+    };
+    std::vector<Action> actions;  // applied at the start of their frame, in log order
+
+    uint8_t type;
+    int32_t frame, lastFrame = -1;
+    while(in.read((char*)&type, 1) && in.read((char*)&frame, sizeof(frame))) {
+        lastFrame = std::max(lastFrame, frame);
+        if(type == EV_BIRTH) in.seekg(sizeof(Plant), std::ios::cur);
+        else if(type == EV_DEATH) in.seekg(sizeof(int32_t), std::ios::cur);
+        else if(type == EV_PHASE) in.seekg(2 * sizeof(int32_t), std::ios::cur);
+        else if(type == EV_END) continue;
+        else if(type == EV_INTERVENTION || type == EV_COMPACT || type == EV_REORDER) {
+            Action action = {frame, type, 0, 0.0f, {}};
+            if(type == EV_INTERVENTION) { readRaw(in, action.kind); readRaw(in, action.amount); }
+            if(type == EV_REORDER) readVector(in, action.ids);
+            if(frame <= targetFrame) actions.push_back(action);
+        } else if(type == EV_KEYFRAME) {
+            uint64_t length;
+            readRaw(in, length);
+            if(frame <= targetFrame) { keyOffset = in.tellg(); keyFrame = frame; }
+            in.seekg(length, std::ios::cur);
+        } else {
+            fprintf(stderr, "%s: corrupt record at frame %d\n", path, frame);
+            return 1;
+        }
+    }
+    if(targetFrame > lastFrame) {
+        fprintf(stderr, "%s: frame %d is past the last logged frame %d\n", path, targetFrame, lastFrame);
+        return 1;
+    }
+    if(keyOffset < 0) {
+        fprintf(stderr, "%s: no keyframe at or before frame %d\n", path, targetFrame);
+        return 1;
+    }
+
+    in.clear();
+    in.seekg(keyOffset);
+    World world;
+    StepController controller;
+    readRaw(in, controller.lastDt);
+    world.load(in);
+
+    for(int32_t f = keyFrame; f <= targetFrame; f++) {
+        for(auto &a : actions) {
+            if(a.frame != f) continue;
+            if(a.type == EV_INTERVENTION) applyIntervention(world, a.kind, a.amount);
+            else if(a.type == EV_COMPACT) world.compact();
+            else world.reorder(a.ids);
+        }
+        world.step(controller.choose(world));
+    }
+
+    printf("Frame,PlantID,X,Y,Z,Age,Size,Health,Alive\n");
+    for(auto &p : world.plants)
+        printf("%d,%d,%g,%g,%g,%g,%g,%g,%d\n", targetFrame, p.id, p.position.x, p.position.y, p.position.z,
+               p.age, p.size, p.health, (int)p.alive);
+    printf("# seed %llu, replayed %d frames from keyframe %d\n", (unsigned long long)seed, targetFrame - keyFrame + 1, keyFrame);
+    return 0;
+}
+
+// Runs the same seeded world with fixed and adaptive steps and reports how far they drift apart.
+int runStepCheck(int ticks, unsigned seed) {
+    const int GRID_SIZE = 40;
+    const float CELL_SIZE = 1.0f;
+    const int NUM_PLANTS = 60;
+    const float HEIGHT_SCALE = 5.0f;
+
+    World fixed(GRID_SIZE, CELL_SIZE, HEIGHT_SCALE, NUM_PLANTS, seed);
+    World adaptive(GRID_SIZE, CELL_SIZE, HEIGHT_SCALE, NUM_PLANTS, seed);
+
+    // Seed dispersal draws random numbers per step, so the two runs would diverge on which plants exist.
+    fixed.reproduction = adaptive.reproduction = false;
+
+    StepController controller;
+    int adaptiveSteps = 0;
+    const int reportEvery = std::max(1, ticks / 10);
+
+    printf("Tick,AdaptiveSteps,AliveFixed,AliveAdaptive,MaxSizeErr,MaxHealthErr\n");
+    for(int t = reportEvery; t <= ticks; t += reportEvery) {
+        while(fixed.time < t) fixed.step(1.0f);
+        while(adaptive.time < t) {
+            adaptive.step(controller.choose(adaptive, (double)t));
+            adaptiveSteps++;
+        }
+
+        float sizeErr = 0.0f, healthErr = 0.0f;
+        for(size_t i = 0; i < fixed.plants.size(); i++) {
+            sizeErr = std::max(sizeErr, std::fabs(fixed.plants[i].size - adaptive.plants[i].size));
+            healthErr = std::max(healthErr, std::fabs(fixed.plants[i].health - adaptive.plants[i].health));
+        }
+        printf("%d,%d,%d,%d,%f,%f\n", t, adaptiveSteps, fixed.aliveCount(), adaptive.aliveCount(), sizeErr, healthErr);
+    }
+    return 0;
+}
+
+// ---------- Recorded History ----------
+// Columnar binary tables for offline analysis. After a 256-byte header naming the columns, the file
+// is a sequence of fixed-size blocks: a 16-byte row count followed by each column as BLOCK_ROWS
+// 32-bit values (zero-padded), so a mapped block can be scanned directly with aligned SIMD loads.
+const char HISTORY_MAGIC[8] = {'E','C','O','H','I','S','T','1'};
+const uint32_t HISTORY_BLOCK_ROWS = 4096;
+const size_t HISTORY_HEADER_BYTES = 256;
+const size_t HISTORY_MAX_COLUMNS = 14;
+
+struct ColumnDef {
+    char name[15];
+    char type;  // 'i' int32, 'f' float32
+};
+
+union HistoryValue {
+    int32_t i;
+    float f;
+    uint32_t bits;
+    HistoryValue(int v) : i(v) {}
+    HistoryValue(float v) : f(v) {}
+};
+
+size_t historyBlockBytes(size_t columns) { return 16 + columns * HISTORY_BLOCK_ROWS * sizeof(uint32_t); }
+
+struct HistoryWriter {
+    std::ofstream out;
+    std::vector<ColumnDef> columns;
+    std::vector<uint32_t> block;  // column-major, BLOCK_ROWS per column
+    uint32_t rows = 0;
+
+    HistoryWriter(const char *path, std::vector<ColumnDef> _columns)
+        : out(path, std::ios::binary), columns(_columns), block(_columns.size() * HISTORY_BLOCK_ROWS, 0) {
+        char header[HISTORY_HEADER_BYTES] = {0};
+        uint32_t numColumns = (uint32_t)columns.size(), blockRows = HISTORY_BLOCK_ROWS;
+        memcpy(header, HISTORY_MAGIC, sizeof(HISTORY_MAGIC));
+        memcpy(header + 8, &numColumns, 4);
+        memcpy(header + 12, &blockRows, 4);
+        memcpy(header + 16, columns.data(), std::min(columns.size(), HISTORY_MAX_COLUMNS) * sizeof(ColumnDef));
+        out.write(header, sizeof(header));
+    }
+
+    ~HistoryWriter() { flush(); }
+
+    void append(std::initializer_list<HistoryValue> values) {
+        size_t c = 0;
+        for(auto &v : values) block[c++ * HISTORY_BLOCK_ROWS + rows] = v.bits;
+        if(++rows == HISTORY_BLOCK_ROWS) flush();
+    }
+
+    void flush() {
+        if(rows == 0) return;
+        uint32_t blockHeader[4] = {rows, 0, 0, 0};
+        out.write((const char*)blockHeader, sizeof(blockHeader));
+        out.write((const char*)block.data(), block.size() * sizeof(uint32_t));
+        out.flush();
+        std::fill(block.begin(), block.end(), 0);
+        rows = 0;
+    }
+};
+
+const std::vector<ColumnDef> PLANT_HISTORY_COLUMNS = {
+    {"frame",'i'}, {"id",'i'}, {"x",'f'}, {"z",'f'}, {"age",'f'}, {"size",'f'}, {"health",'f'}};
+const std::vector<ColumnDef> SOIL_HISTORY_COLUMNS = {
+    {"frame",'i'}, {"x",'i'}, {"z",'i'}, {"water",'f'}, {"nitrogen",'f'}, {"phosphorus",'f'}, {"potassium",'f'},
+    {"seedlings",'f'}};
+
+void recordHistory(const World &world, int frame, HistoryWriter &plantHistory, HistoryWriter &soilHistory) {
+    for(auto &p : world.plants)
+        if(p.alive)
+            plantHistory.append({frame, p.id, p.position.x, p.position.z, p.age, p.size, p.health});
+    for(size_t i = 0; i < world.soil.size(); i++) {
+        const SoilCell &c = world.soil[i];
+        soilHistory.append({frame, (int)c.position.x, (int)c.position.y, c.water, c.nitrogen, c.phosphorus,
+                            c.potassium, world.seedlings.count[i]});
+    }
+}
+
+// ---------- History Query Engine ----------
+// Answers one filter/group/aggregate query over a mapped history table, e.g.
+//   mean(health) where x>=-5 and x<5 and frame>=100 and frame<=500
+//   frac(nitrogen<0.2) by frame
+// Blocks are handed to threads from a shared counter; within a block every predicate is evaluated
+// four rows at a time into a lane mask that the aggregation then consumes.
+enum CompareOp { CMP_LT, CMP_LE, CMP_GT, CMP_GE, CMP_EQ, CMP_NE };
+enum AggregateKind { AGG_COUNT, AGG_SUM, AGG_MEAN, AGG_MIN, AGG_MAX, AGG_FRAC };
+
+struct Predicate {
+    int column;
+    CompareOp op;
+    HistoryValue threshold = 0;
+};
+
+struct Query {
+    AggregateKind kind = AGG_COUNT;
+    int valueColumn = -1;
+    Predicate fracPredicate;
+    std::vector<Predicate> where;
+    int groupColumn = -1;
+};
+
+struct Aggregate {
+    double sum = 0.0;
+    double matched = 0.0;  // rows passing where (and the frac predicate)
+    double rows = 0.0;     // rows passing where; denominator of frac
+    float min = INFINITY, max = -INFINITY;
+
+    void merge(const Aggregate &o) {
+        sum += o.sum; matched += o.matched; rows += o.rows;
+        min = std::min(min, o.min); max = std::max(max, o.max);
+    }
+
+    double result(AggregateKind kind) const {
+        switch(kind) {
+            case AGG_COUNT: return matched;
+            case AGG_SUM: return sum;
+            case AGG_MEAN: return matched > 0 ? sum / matched : NAN;
+            case AGG_MIN: return min;
+            case AGG_MAX: return max;
+            case AGG_FRAC: return rows > 0 ? matched / rows : NAN;
+        }
+        return NAN;
+    }
+};
+
+struct HistoryTable {
+    const char *base = nullptr;
+    size_t bytes = 0;
+    std::vector<ColumnDef> columns;
+    size_t blocks = 0;
+
+    bool open(const char *path) {
+        int fd = ::open(path, O_RDONLY);
+        if(fd < 0) return false;
+        struct stat st;
+        if(fstat(fd, &st) < 0 || st.st_size < (off_t)HISTORY_HEADER_BYTES) { close(fd); return false; }
+        void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if(data == MAP_FAILED) return false;
+        base = (const char*)data;
+        bytes = st.st_size;
+
+        uint32_t numColumns, blockRows;
+        memcpy(&numColumns, base + 8, 4);
+        memcpy(&blockRows, base + 12, 4);
+        if(memcmp(base, HISTORY_MAGIC, sizeof(HISTORY_MAGIC)) != 0 || blockRows != HISTORY_BLOCK_ROWS ||
+           numColumns == 0 || numColumns > HISTORY_MAX_COLUMNS)
+            return false;
+        columns.assign((const ColumnDef*)(base + 16), (const ColumnDef*)(base + 16) + numColumns);
+        blocks = (bytes - HISTORY_HEADER_BYTES) / historyBlockBytes(numColumns);  // a torn tail block is ignored
+        return true;
+    }
+
+    ~HistoryTable() { if(base) munmap((void*)base, bytes); }
+
+    const char *block(size_t b) const { return base + HISTORY_HEADER_BYTES + b * historyBlockBytes(columns.size()); }
+    uint32_t blockRows(size_t b) const { return *(const uint32_t*)block(b); }
+    const uint32_t *column(size_t b, int c) const {
+        return (const uint32_t*)(block(b) + 16) + (size_t)c * HISTORY_BLOCK_ROWS;
+    }
+
+    int find(const std::string &name) const {
+        for(size_t c = 0; c < columns.size(); c++)
+            if(name == std::string(columns[c].name, strnlen(columns[c].name, sizeof(columns[c].name)))) return (int)c;
+        return -1;
+    }
+};
+
+// ANDs "column op threshold" into mask (0 or all-ones per row).
+void applyPredicate(const Predicate &p, char type, const uint32_t *col, int32_t *mask) {
+#if defined(__SSE2__)
+    if(type == 'f') {
+        __m128 t = _mm_set1_ps(p.threshold.f);
+        for(uint32_t i = 0; i < HISTORY_BLOCK_ROWS; i += 4) {
+            __m128 v = _mm_load_ps((const float*)col + i);
+            __m128 r;
+            switch(p.op) {
+                case CMP_LT: r = _mm_cmplt_ps(v, t); break;
+                case CMP_LE: r = _mm_cmple_ps(v, t); break;
+                case CMP_GT: r = _mm_cmpgt_ps(v, t); break;
+                case CMP_GE: r = _mm_cmpge_ps(v, t); break;
+                case CMP_EQ: r = _mm_cmpeq_ps(v, t); break;
+                default:     r = _mm_cmpneq_ps(v, t); break;
+            }
+            __m128i m = _mm_load_si128((const __m128i*)(mask + i));
+            _mm_store_si128((__m128i*)(mask + i), _mm_and_si128(m, _mm_castps_si128(r)));
+        }
+    } else {
+        __m128i t = _mm_set1_epi32(p.threshold.i);
+        for(uint32_t i = 0; i < HISTORY_BLOCK_ROWS; i += 4) {
+            __m128i v = _mm_load_si128((const __m128i*)(col + i));
+            __m128i m = _mm_load_si128((const __m128i*)(mask + i));
+            switch(p.op) {
+                case CMP_LT: m = _mm_and_si128(m, _mm_cmplt_epi32(v, t)); break;
+                case CMP_LE: m = _mm_andnot_si128(_mm_cmpgt_epi32(v, t), m); break;
+                case CMP_GT: m = _mm_and_si128(m, _mm_cmpgt_epi32(v, t)); break;
+                case CMP_GE: m = _mm_andnot_si128(_mm_cmplt_epi32(v, t), m); break;
+                case CMP_EQ: m = _mm_and_si128(m, _mm_cmpeq_epi32(v, t)); break;
+                default:     m = _mm_andnot_si128(_mm_cmpeq_epi32(v, t), m); break;
+            }
+            _mm_store_si128((__m128i*)(mask + i), m);
+        }
+    }
+#else
+    for(uint32_t i = 0; i < HISTORY_BLOCK_ROWS; i++) {
+        HistoryValue v = 0;
+        v.bits = col[i];
+        float a = type == 'f' ? v.f : (float)v.i, b = type == 'f' ? p.threshold.f : (float)p.threshold.i;
+        bool pass = type == 'f'
+            ? (p.op == CMP_LT ? a < b : p.op == CMP_LE ? a <= b : p.op == CMP_GT ? a > b :
+               p.op == CMP_GE ? a >= b : p.op == CMP_EQ ? a == b : a != b)
+            : (p.op == CMP_LT ? v.i < p.threshold.i : p.op == CMP_LE ? v.i <= p.threshold.i :
+               p.op == CMP_GT ? v.i > p.threshold.i : p.op == CMP_GE ? v.i >= p.threshold.i :
+               p.op == CMP_EQ ? v.i == p.threshold.i : v.i != p.threshold.i);
+        mask[i] &= pass ? -1 : 0;
+    }
+#endif
+}
+
+// Sums, counts and min/max of the masked rows of one float column.
+void aggregateMasked(const float *values, const int32_t *mask, const int32_t *rowMask, Aggregate &acc) {
+#if defined(__SSE2__)
+    // Lane sums are widened to double: 4096 float adds per lane would lose the low digits of sum().
+    __m128d sumLow = _mm_setzero_pd(), sumHigh = _mm_setzero_pd();
+    __m128 lo = _mm_set1_ps(INFINITY), hi = _mm_set1_ps(-INFINITY);
+    __m128i matched = _mm_setzero_si128(), rows = _mm_setzero_si128();
+    for(uint32_t i = 0; i < HISTORY_BLOCK_ROWS; i += 4) {
+        __m128 v = values ? _mm_load_ps(values + i) : _mm_setzero_ps();
+        __m128i m = _mm_load_si128((const __m128i*)(mask + i));
+        __m128 mf = _mm_castsi128_ps(m);
+        __m128 picked = _mm_and_ps(mf, v);
+        sumLow = _mm_add_pd(sumLow, _mm_cvtps_pd(picked));
+        sumHigh = _mm_add_pd(sumHigh, _mm_cvtps_pd(_mm_movehl_ps(picked, picked)));
+        lo = _mm_min_ps(lo, _mm_or_ps(_mm_and_ps(mf, v), _mm_andnot_ps(mf, _mm_set1_ps(INFINITY))));
+        hi = _mm_max_ps(hi, _mm_or_ps(_mm_and_ps(mf, v), _mm_andnot_ps(mf, _mm_set1_ps(-INFINITY))));
+        matched = _mm_sub_epi32(matched, m);
+        rows = _mm_sub_epi32(rows, _mm_load_si128((const __m128i*)(rowMask + i)));
+    }
+    alignas(16) double s[4];
+    alignas(16) float l[4], h[4];
+    alignas(16) int32_t c[4], r[4];
+    _mm_store_pd(s, sumLow); _mm_store_pd(s + 2, sumHigh); _mm_store_ps(l, lo); _mm_store_ps(h, hi);
+    _mm_store_si128((__m128i*)c, matched); _mm_store_si128((__m128i*)r, rows);
+    for(int k = 0; k < 4; k++) {
+        acc.sum += s[k]; acc.matched += c[k]; acc.rows += r[k];
+        acc.min = std::min(acc.min, l[k]); acc.max = std::max(acc.max, h[k]);
+    }
+#else
+    for(uint32_t i = 0; i < HISTORY_BLOCK_ROWS; i++) {
+        acc.rows += rowMask[i] ? 1 : 0;
+        if(!mask[i]) continue;
+        float v = values ? values[i] : 0.0f;
+        acc.sum += v; acc.matched += 1;
+        acc.min = std::min(acc.min, v); acc.max = std::max(acc.max, v);
+    }
+#endif
+}
+
+struct QueryResult {
+    Aggregate total;
+    std::map<int32_t,Aggregate> groups;
+};
+
+QueryResult runQueryScan(const HistoryTable &table, const Query &q, int threads) {
+    std::atomic<size_t> nextBlock{0};
+    std::vector<QueryResult> partial(threads);
+
+    auto scan = [&](QueryResult &out) {
+        alignas(16) static thread_local int32_t whereMask[HISTORY_BLOCK_ROWS], matchMask[HISTORY_BLOCK_ROWS];
+        alignas(16) static thread_local float converted[HISTORY_BLOCK_ROWS];
+        std::unordered_map<int32_t,Aggregate> groups;
+
+        for(size_t b; (b = nextBlock++) < table.blocks;) {
+            uint32_t rows = table.blockRows(b);
+            for(uint32_t i = 0; i < HISTORY_BLOCK_ROWS; i++) whereMask[i] = i < rows ? -1 : 0;
+            for(auto &p : q.where) applyPredicate(p, table.columns[p.column].type, table.column(b, p.column), whereMask);
+
+            memcpy(matchMask, whereMask, sizeof(matchMask));
+            if(q.kind == AGG_FRAC)
+                applyPredicate(q.fracPredicate, table.columns[q.fracPredicate.column].type,
+                               table.column(b, q.fracPredicate.column), matchMask);
+
+            const float *values = nullptr;
+            if(q.valueColumn >= 0) {
+                values = (const float*)table.column(b, q.valueColumn);
+                if(table.columns[q.valueColumn].type == 'i') {
+                    const int32_t *ints = (const int32_t*)values;
+                    for(uint32_t i = 0; i < HISTORY_BLOCK_ROWS; i++) converted[i] = (float)ints[i];
+                    values = converted;
+                }
+            }
+
+            if(q.groupColumn < 0) {
+                aggregateMasked(values, matchMask, whereMask, out.total);
+                continue;
+            }
+
+            // History is written frame by frame, so group keys come in long runs; accumulate a run
+            // locally and touch the hash map only when the key changes.
+            const int32_t *keys = (const int32_t*)table.column(b, q.groupColumn);
+            Aggregate run;
+            int32_t runKey = 0;
+            bool inRun = false;
+            for(uint32_t i = 0; i < rows; i++) {
+                if(!whereMask[i]) continue;
+                if(!inRun || keys[i] != runKey) {
+                    if(inRun) groups[runKey].merge(run);
+                    run = Aggregate();
+                    runKey = keys[i];
+                    inRun = true;
+                }
+                run.rows += 1;
+                if(!matchMask[i]) continue;
+                float v = values ? values[i] : 0.0f;
+                run.sum += v; run.matched += 1;
+                run.min = std::min(run.min, v); run.max = std::max(run.max, v);
+            }
+            if(inRun) groups[runKey].merge(run);
+        }
+        for(auto &[key, acc] : groups) out.groups[key].merge(acc);
+    };
+
+    std::vector<std::thread> workers;
+    for(int t = 1; t < threads; t++) workers.emplace_back(scan, std::ref(partial[t]));
+    scan(partial[0]);
+    for(auto &w : workers) w.join();
+
+    QueryResult result;
+    for(auto &p : partial) {
+        result.total.merge(p.total);
+        for(auto &[key, acc] : p.groups) result.groups[key].merge(acc);
+    }
+    return result;
+}
+
+std::string parsePredicate(const HistoryTable &table, const std::string &text, Predicate &p) {
+    static const char *ops[] = {"<=", ">=", "!=", "==", "<", ">", "="};
+    static const CompareOp codes[] = {CMP_LE, CMP_GE, CMP_NE, CMP_EQ, CMP_LT, CMP_GT, CMP_EQ};
+    for(int k = 0; k < 7; k++) {
+        size_t at = text.find(ops[k]);
+        if(at == std::string::npos) continue;
+        p.column = table.find(text.substr(0, at));
+        if(p.column < 0) return "unknown column in " + text;
+        p.op = codes[k];
+        std::string value = text.substr(at + strlen(ops[k]));
+        if(table.columns[p.column].type == 'f') p.threshold = HistoryValue((float)atof(value.c_str()));
+        else p.threshold = HistoryValue(atoi(value.c_str()));
+        return "";
+    }
+    return "expected a comparison, got " + text;
+}
+
+std::string parseQuery(const HistoryTable &table, const std::string &text, Query &q) {
+    std::istringstream words(text);
+    std::string word;
+    words >> word;
+
+    static const char *names[] = {"count", "sum", "mean", "min", "max", "frac"};
+    size_t paren = word.find('(');
+    std::string name = word.substr(0, paren), arg;
+    if(paren != std::string::npos) {
+        if(word.back() != ')') return "unbalanced parentheses in " + word;
+        arg = word.substr(paren + 1, word.size() - paren - 2);
+    }
+    int kind = -1;
+    for(int k = 0; k < 6; k++)
+        if(name == names[k]) kind = k;
+    if(kind < 0) return "unknown aggregate " + name;
+    q.kind = (AggregateKind)kind;
+    if(q.kind == AGG_FRAC) {
+        std::string error = parsePredicate(table, arg, q.fracPredicate);
+        if(!error.empty()) return error;
+    } else if(q.kind != AGG_COUNT) {
+        q.valueColumn = table.find(arg);
+        if(q.valueColumn < 0) return "unknown column " + arg;
+    }
+
+    while(words >> word) {
+        if(word == "where" || word == "and") {
+            if(!(words >> word)) return "missing predicate";
+            Predicate p;
+            std::string error = parsePredicate(table, word, p);
+            if(!error.empty()) return error;
+            q.where.push_back(p);
+        } else if(word == "by") {
+            if(!(words >> word) || (q.groupColumn = table.find(word)) < 0) return "unknown group column";
+            if(table.columns[q.groupColumn].type != 'i') return "can only group by an integer column";
+        } else {
+            return "unexpected " + word;
+        }
+    }
+    return "";
+}
+
+int runQuery(const char *path, const std::string &text) {
+    HistoryTable table;
+    if(!table.open(path)) {
+        fprintf(stderr, "%s: not a readable EcoSphere history table\n", path);
+        return 1;
+    }
+    Query q;
+    std::string error = parseQuery(table, text, q);
+    if(!error.empty()) {
+        fprintf(stderr, "query: %s\n", error.c_str());
+        return 1;
+    }
+
+    int threads = (int)std::max(1u, std::thread::hardware_concurrency());
+    auto start = std::chrono::steady_clock::now();
+    QueryResult result = runQueryScan(table, q, threads);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if(q.groupColumn < 0) {
+        printf("%.9g\n", result.total.result(q.kind));
+    } else {
+        printf("%s,value\n", table.columns[q.groupColumn].name);
+        for(auto &[key, acc] : result.groups) printf("%d,%.9g\n", key, acc.result(q.kind));
+    }
+    double scanned = (double)table.blocks * historyBlockBytes(table.columns.size());
+    fprintf(stderr, "scanned %zu blocks (%.1f MB) in %.3f s on %d threads, %.2f GB/s\n", table.blocks,
+            scanned / 1e6, seconds, threads, seconds > 0 ? scanned / seconds / 1e9 : 0.0);
+    return 0;
+}
+
+// ---------- Scenarios ----------
+struct Scenario {
+    const char *name;
+    int gridSize;
+    float cellSize;
+    float heightScale;
+    int numPlants;
+    bool reproduction;
+};
+
+const Scenario SCENARIOS[] = {
+    {"default", 40, 1.0f, 5.0f, 60, true},
+    {"sparse", 40, 1.0f, 5.0f, 15, true},
+    {"dense", 40, 1.0f, 5.0f, 300, true},
+    {"static", 40, 1.0f, 5.0f, 60, false},
+};
+
+const Scenario *findScenario(const std::string &name) {
+    for(auto &sc : SCENARIOS)
+        if(name == sc.name) return &sc;
+    return nullptr;
+}
+
+World makeWorld(const Scenario &sc, uint64_t seed) {
+    World world(sc.gridSize, sc.cellSize, sc.heightScale, sc.numPlants, seed);
+    world.reproduction = sc.reproduction;
+    return world;
+}
+
+// raylib's TextFormat hands out shared static buffers, which worker threads must not use.
+std::string formatLine(const char *fmt, ...) {
+    char buffer[512];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(buffer, sizeof(buffer), fmt, args);
+    va_end(args);
+    return buffer;
+}
+
+// ---------- Spin-up Cache ----------
+// Replicates of a scenario share the same burn-in, so the world state after it is stored once under
+// a hash of (scenario, seed, burn-in length, code version) and memory-mapped by later runs.
+// Bump CODE_VERSION whenever the update rule changes, or stale states will be reused.
+const char *CODE_VERSION = "ecosphere-6";
+const char *SPINUP_DIR = "spinup_cache";
+const char SPINUP_MAGIC[8] = {'E','C','O','S','P','I','N','1'};
+
+struct Fnv1a {
+    uint64_t hash = 0xcbf29ce484222325ull;
+
+    void add(const void *data, size_t n) {
+        for(size_t i = 0; i < n; i++) {
+            hash ^= ((const unsigned char*)data)[i];
+            hash *= 0x100000001b3ull;
+        }
+    }
+    template<typename T> void add(const T &v) { add(&v, sizeof(T)); }
+};
+
+uint64_t spinUpKey(const Scenario &sc, uint64_t seed, double burnIn) {
+    Fnv1a h;
+    h.add(sc.name, strlen(sc.name));
+    h.add(sc.gridSize); h.add(sc.cellSize); h.add(sc.heightScale);
+    h.add(sc.numPlants); h.add(sc.reproduction);
+    h.add(seed); h.add(burnIn);
+    h.add(CODE_VERSION, strlen(CODE_VERSION));
+    h.add(sizeof(Plant)); h.add(sizeof(SoilCell));
+    return h.hash;
+}
+
+// Read-only view of a mapped file as a std::istream source.
+struct MemoryBuf : std::streambuf {
+    MemoryBuf(const char *data, size_t size) { setg((char*)data, (char*)data, (char*)data + size); }
+};
+
+bool loadSpinUp(const std::string &path, uint64_t key, World &world, StepController &controller) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0) return false;
+    struct stat st;
+    if(fstat(fd, &st) < 0 || st.st_size < (off_t)(sizeof(SPINUP_MAGIC) + sizeof(key))) { close(fd); return false; }
+    void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED) return false;
+
+    MemoryBuf buf((const char*)data, st.st_size);
+    std::istream in(&buf);
+    char magic[sizeof(SPINUP_MAGIC)];
+    uint64_t storedKey = 0;
+    in.read(magic, sizeof(magic));
+    readRaw(in, storedKey);
+    bool ok = memcmp(magic, SPINUP_MAGIC, sizeof(magic)) == 0 && storedKey == key;
+    if(ok) {
+        readRaw(in, controller.lastDt);
+        world.load(in);
+        ok = (bool)in;
+    }
+    munmap(data, st.st_size);
+    return ok;
+}
+
+// Written to a temporary name and renamed, so concurrent runs never map a half-written state.
+void saveSpinUp(const std::string &path, uint64_t key, const World &world, const StepController &controller) {
+    mkdir(SPINUP_DIR, 0755);
+    size_t thread = std::hash<std::thread::id>()(std::this_thread::get_id());
+    std::string tmp = path + formatLine(".%d.%zx.tmp", (int)getpid(), thread);
+    {
+        std::ofstream out(tmp, std::ios::binary);
+        out.write(SPINUP_MAGIC, sizeof(SPINUP_MAGIC));
+        writeRaw(out, key);
+        writeRaw(out, controller.lastDt);
+        world.save(out);
+        if(!out) { unlink(tmp.c_str()); return; }
+    }
+    rename(tmp.c_str(), path.c_str());
+}
+
+std::string spinUpPath(uint64_t key) {
+    return std::string(SPINUP_DIR) + formatLine("/%016llx.bin", (unsigned long long)key);
+}
+
+// A resident headless process that takes jobs over a Unix socket, one per line:
+//   run scenario=default seeds=1-8 ticks=20000 burnin=5000 out=results.csv
+// Each seed becomes a task. Tasks run in slices of SLICE_TICKS on a shared worker pool, and jobs take
+// turns round-robin, so a job with hundreds of seeds cannot starve a one-seed job submitted after it.
+// Progress and per-seed results are streamed back on the submitting connection.
+const double SLICE_TICKS = 2000.0;
+
+// Replies are queued and written by a per-connection thread, so neither the scheduler nor a worker ever
+// waits on a slow client. Progress lines are optional and dropped once a client falls behind.
+struct Connection {
+    static constexpr size_t OUTBOX_LIMIT = 256;
+
+    int fd;
+    std::atomic<bool> open{true};     // false once a reply could not be written; its jobs are dropped
+    std::atomic<bool> reading{true};  // false once serveConnection has returned
+    std::mutex outLock;
+    std::condition_variable outReady;
+    std::deque<std::string> outbox;
+    bool closing = false;
+    std::thread writer;
+
+    explicit Connection(int _fd) : fd(_fd) {
+        timeval timeout = {5, 0};
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        writer = std::thread([this]{ writeLoop(); });
+    }
+
+    // Drains what is queued (bounded by the send timeout) before closing the socket.
+    ~Connection() {
+        { std::lock_guard<std::mutex> guard(outLock); closing = true; }
+        outReady.notify_one();
+        writer.join();
+        close(fd);
+    }
+
+    void send(const std::string &line, bool optional = false) {
+        {
+            std::lock_guard<std::mutex> guard(outLock);
+            if(!open || (optional && outbox.size() >= OUTBOX_LIMIT)) return;
+            outbox.push_back(line + "\n");
+        }
+        outReady.notify_one();
+    }
+
+    void writeLoop() {
+        std::unique_lock<std::mutex> guard(outLock);
+        for(;;) {
+            outReady.wait(guard, [this]{ return closing || !outbox.empty(); });
+            if(outbox.empty()) return;
+            std::string msg = std::move(outbox.front());
+            outbox.pop_front();
+            guard.unlock();
+
+            size_t done = 0;
+            while(done < msg.size()) {
+                ssize_t n = write(fd, msg.data() + done, msg.size() - done);
+                if(n <= 0) break;
+                done += n;
+            }
+
+            guard.lock();
+            if(done < msg.size()) {
+                open = false;
+                outbox.clear();
+            }
+        }
+    }
+};
+
+struct Job;
+
+struct Task {
+    uint64_t seed;
+    bool started = false;
+    bool cached = false;
+    bool burningIn = false;  // the burn-in is being computed and still has to be checkpointed
+    uint64_t spinUpKey = 0;
+    World world;
+    StepController controller;
+    int steps = 0;
+};
+
+struct Job {
+    int id;
+    const Scenario *scenario;
+    std::vector<uint64_t> seeds;
+    int ticks;
+    double burnIn = 0.0;
+    std::string outPath;
+    std::shared_ptr<Connection> client;
+
+    std::deque<std::unique_ptr<Task>> ready;  // guarded by the scheduler lock
+    int remaining = 0;                        // guarded by the scheduler lock
+
+    std::mutex outLock;
+    std::ofstream out;
+};
+
+struct JobScheduler {
+    std::mutex lock;
+    std::condition_variable wake;
+    std::deque<std::shared_ptr<Job>> turn;  // jobs that have ready tasks, in round-robin order
+    std::vector<std::thread> workers;
+    bool stopping = false;
+    int nextJobId = 1;
+
+    void start(int threads) {
+        for(int i = 0; i < threads; i++)
+            workers.emplace_back([this]{ workerLoop(); });
+    }
+
+    // Tasks still queued when the workers exit are dropped, and their clients are told so.
+    void stop() {
+        { std::lock_guard<std::mutex> guard(lock); stopping = true; }
+        wake.notify_all();
+        for(auto &w : workers) w.join();
+        workers.clear();
+
+        for(auto &job : turn)
+            job->client->send(formatLine("error job=%d cancelled with %d tasks unfinished: server shutting down",
+                                         job->id, job->remaining));
+        turn.clear();
+    }
+
+    // Returns the job id, or -1 once the scheduler is stopping.
+    int submit(std::shared_ptr<Job> job) {
+        std::lock_guard<std::mutex> guard(lock);
+        if(stopping) return -1;
+        job->id = nextJobId++;
+        for(uint64_t seed : job->seeds) {
+            auto task = std::make_unique<Task>();
+            task->seed = seed;
+            job->ready.push_back(std::move(task));
+        }
+        job->remaining = (int)job->ready.size();
+        turn.push_back(job);
+        wake.notify_all();
+        return job->id;
+    }
+
+    // Advances one task by a slice; returns true once it has reached the job's tick count. A burn-in
+    // missing from the spin-up cache is computed in slices like the rest of the run and saved when
+    // the task reaches it.
+    bool runSlice(Job &job, Task &task) {
+        if(!task.started) {
+            if(job.burnIn > 0.0) {
+                task.spinUpKey = spinUpKey(*job.scenario, task.seed, job.burnIn);
+                task.cached = loadSpinUp(spinUpPath(task.spinUpKey), task.spinUpKey, task.world, task.controller);
+                task.burningIn = !task.cached;
+            }
+            if(!task.cached) task.world = makeWorld(*job.scenario, task.seed);
+            task.started = true;
+        }
+        double target = std::min((double)job.ticks, task.world.time + SLICE_TICKS);
+        if(task.burningIn) target = std::min(target, job.burnIn);
+        while(task.world.time < target) {
+            task.world.step(task.controller.choose(task.world, target));
+            if(!task.burningIn) task.steps++;
+        }
+        if(task.burningIn && task.world.time >= job.burnIn) {
+            saveSpinUp(spinUpPath(task.spinUpKey), task.spinUpKey, task.world, task.controller);
+            task.burningIn = false;
+        }
+
+        if(task.world.time < job.ticks) {
+            job.client->send(formatLine("progress job=%d seed=%llu tick=%.0f/%d", job.id,
+                             (unsigned long long)task.seed, task.world.time, job.ticks), true);
+            return false;
+        }
+
+        const World &w = task.world;
+        float sizeSum = 0.0f;
+        for(auto &p : w.plants)
+            if(p.alive) sizeSum += p.size;
+        int alive = w.aliveCount();
+        float meanSize = alive > 0 ? sizeSum / alive : 0.0f;
+
+        job.client->send(formatLine("result job=%d seed=%llu tick=%.0f steps=%d alive=%d plants=%d seedlings=%.1f meanSize=%.4f spinup=%s",
+                         job.id, (unsigned long long)task.seed, w.time, task.steps, alive, (int)w.plants.size(),
+                         w.seedlings.total(), meanSize, job.burnIn <= 0.0 ? "none" : task.cached ? "cached" : "computed"));
+        if(job.out.is_open()) {
+            std::lock_guard<std::mutex> guard(job.outLock);
+            job.out << job.id << "," << task.seed << "," << w.time << "," << task.steps << "," << alive << ","
+                    << w.plants.size() << "," << w.seedlings.total() << "," << meanSize << "\n";
+            job.out.flush();
+        }
+        return true;
+    }
+
+    void workerLoop() {
+        std::unique_lock<std::mutex> guard(lock);
+        for(;;) {
+            wake.wait(guard, [this]{ return stopping || !turn.empty(); });
+            if(stopping) return;
+
+            auto job = turn.front();
+            turn.pop_front();
+            auto task = std::move(job->ready.front());
+            job->ready.pop_front();
+            if(!job->ready.empty()) turn.push_back(job);
+            guard.unlock();
+
+            bool finished = runSlice(*job, *task);
+
+            guard.lock();
+            if(!finished && job->client->open) {
+                job->ready.push_back(std::move(task));
+                if(job->ready.size() == 1) turn.push_back(job);
+                wake.notify_one();
+            } else if(--job->remaining == 0) {
+                // This is the job's last reference, and releasing it may close the connection, which
+                // waits on the socket, so it happens outside the lock.
+                guard.unlock();
+                job->client->send(formatLine("done job=%d", job->id));
+                job.reset();
+                guard.lock();
+            }
+        }
+    }
+};
+
+const size_t MAX_JOB_SEEDS = 100000;
+
+// Parses "run scenario=<name> seeds=1,2,5-9 ticks=<n> [burnin=<n>] [out=<path>]"; returns an error message or "".
+std::string parseJob(const std::string &line, Job &job) {
+    std::istringstream words(line);
+    std::string word;
+    words >> word;
+    if(word != "run") return "unknown command";
+
+    job.scenario = &SCENARIOS[0];
+    job.ticks = 10000;
+    while(words >> word) {
+        size_t eq = word.find('=');
+        if(eq == std::string::npos) return "expected key=value, got " + word;
+        std::string key = word.substr(0, eq), value = word.substr(eq + 1);
+        if(key == "scenario") {
+            job.scenario = findScenario(value);
+            if(!job.scenario) return "unknown scenario " + value;
+        } else if(key == "ticks") {
+            job.ticks = atoi(value.c_str());
+        } else if(key == "burnin") {
+            job.burnIn = (double)atoi(value.c_str());
+        } else if(key == "out") {
+            job.outPath = value;
+        } else if(key == "seeds") {
+            std::istringstream list(value);
+            std::string item;
+            while(std::getline(list, item, ',')) {
+                const char *text = item.c_str();
+                char *end;
+                if(!isdigit((unsigned char)*text)) return "bad seed list " + value;
+                uint64_t lo = strtoull(text, &end, 10), hi = lo;
+                if(*end == '-') {
+                    if(!isdigit((unsigned char)end[1])) return "bad seed list " + value;
+                    hi = strtoull(end + 1, &end, 10);
+                }
+                if(*end != '\0' || hi < lo) return "bad seed list " + value;
+                if(hi - lo >= MAX_JOB_SEEDS || job.seeds.size() + (hi - lo) >= MAX_JOB_SEEDS)
+                    return formatLine("at most %d seeds per job", (int)MAX_JOB_SEEDS);
+                for(uint64_t seed = lo; seed <= hi; seed++) job.seeds.push_back(seed);
+            }
+            if(job.seeds.empty()) return "bad seed list " + value;
+        } else {
+            return "unknown key " + key;
+        }
+    }
+    if(job.seeds.empty()) job.seeds.push_back(1);
+    if(job.ticks <= 0) return "ticks must be positive";
+    if(job.burnIn < 0.0 || job.burnIn >= job.ticks) return "burnin must be between 0 and ticks";
+    return "";
+}
+
+sockaddr_un socketAddress(const char *path) {
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    return addr;
+}
+
+void serveConnection(std::shared_ptr<Connection> client, JobScheduler &scheduler, int listenFd) {
+    std::string pending;
+    char buffer[4096];
+    ssize_t n;
+    while(client->open && (n = read(client->fd, buffer, sizeof(buffer))) > 0) {
+        pending.append(buffer, n);
+        size_t end;
+        while((end = pending.find('\n')) != std::string::npos) {
+            std::string line = pending.substr(0, end);
+            pending.erase(0, end + 1);
+            if(line.empty()) continue;
+            if(line == "shutdown") {
+                shutdown(listenFd, SHUT_RDWR);
+                client->reading = false;
+                return;
+            }
+
+            auto job = std::make_shared<Job>();
+            job->client = client;
+            std::string error = parseJob(line, *job);
+            if(error.empty() && !job->outPath.empty()) {
+                job->out.open(job->outPath, std::ios::app);
+                if(!job->out) error = "cannot open " + job->outPath;
+                else if(job->out.tellp() == 0) job->out << "Job,Seed,Tick,Steps,Alive,Plants,Seedlings,MeanSize\n";
+            }
+            if(!error.empty()) {
+                client->send("error " + error);
+                continue;
+            }
+            int id = scheduler.submit(job);
+            if(id < 0) client->send("error server shutting down");
+            else client->send(formatLine("accepted job=%d tasks=%d", id, (int)job->seeds.size()));
+        }
+    }
+    // End of input only ends reading: a client may half-close after its job lines and still wait for
+    // the replies. The socket closes once its jobs release the connection.
+    client->reading = false;
+}
+
+int runServer(const char *path, int threads) {
+    signal(SIGPIPE, SIG_IGN);
+
+    int listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr = socketAddress(path);
+    unlink(path);
+    if(listenFd < 0 || bind(listenFd, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(listenFd, 64) < 0) {
+        perror(path);
+        return 1;
+    }
+
+    JobScheduler scheduler;
+    scheduler.start(threads);
+    fprintf(stderr, "EcoSphere server on %s with %d workers\n", path, threads);
+
+    // Connection threads are joined, never detached, so none outlives the scheduler it submits to.
+    // Sessions hold the connection weakly, so it closes as soon as its reader and jobs are done.
+    std::vector<std::pair<std::weak_ptr<Connection>, std::thread>> sessions;
+    int fd;
+    while((fd = accept(listenFd, nullptr, nullptr)) >= 0) {
+        for(size_t i = 0; i < sessions.size(); ) {
+            auto client = sessions[i].first.lock();
+            if(client && client->reading) { i++; continue; }
+            sessions[i].second.join();
+            sessions.erase(sessions.begin() + i);
+        }
+        auto client = std::make_shared<Connection>(fd);
+        sessions.emplace_back(client, std::thread(serveConnection, client, std::ref(scheduler), listenFd));
+    }
+
+    scheduler.stop();
+    for(auto &[session, thread] : sessions) {
+        if(auto client = session.lock()) shutdown(client->fd, SHUT_RD);
+        thread.join();
+    }
+    sessions.clear();
+    close(listenFd);
+    unlink(path);
+    return 0;
+}
+
+// Minimal client: sends one job line and prints the streamed replies until the job is done.
+int runSubmit(const char *path, const std::string &line) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr = socketAddress(path);
+    if(fd < 0 || connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+        perror(path);
+        return 1;
+    }
+    std::string msg = line + "\n";
+    if(write(fd, msg.data(), msg.size()) != (ssize_t)msg.size()) {
+        perror(path);
+        return 1;
+    }
+    if(line == "shutdown") { close(fd); return 0; }
+
+    std::string pending;
+    char buffer[4096];
+    ssize_t n;
+    while((n = read(fd, buffer, sizeof(buffer))) > 0) {
+        pending.append(buffer, n);
+        size_t end;
+        while((end = pending.find('\n')) != std::string::npos) {
+            std::string reply = pending.substr(0, end);
+            pending.erase(0, end + 1);
+            printf("%s\n", reply.c_str());
+            fflush(stdout);
+            if(reply.compare(0, 5, "done ") == 0 || reply.compare(0, 6, "error ") == 0) {
+                close(fd);
+                return reply[0] == 'e';
+            }
+        }
+    }
+    close(fd);
+    return 1;
+}
+
+// ---------- Metapopulation Ensemble ----------
+// An archipelago of habitat patches, each its own World, coupled by seed migration. Patches are
+// split statically over worker threads and run independently between exchange ticks. At each
+// exchange a patch moves a fraction of its seedlings into bounded single-producer/single-consumer
+// mailboxes, one per directed edge of a ring lattice. Workers meet at barriers only at exchange
+// ticks, never between them; after the first one every patch drains its incoming mailboxes.
+// Messages carry their exchange epoch and a consumer never takes one from a later epoch, so
+// results do not depend on thread timing or the number of workers.
+template<typename T, size_t N> struct SpscQueue {
+    T items[N];
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+
+    bool push(const T &item) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if(t - head.load(std::memory_order_acquire) == N) return false;
+        items[t % N] = item;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    const T *front() const {
+        size_t h = head.load(std::memory_order_relaxed);
+        if(h == tail.load(std::memory_order_acquire)) return nullptr;
+        return &items[h % N];
+    }
+
+    void pop() { head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+};
+
+struct Barrier {
+    std::mutex lock;
+    std::condition_variable wake;
+    int threads, waiting = 0;
+    uint64_t generation = 0;
+
+    explicit Barrier(int _threads) : threads(_threads) {}
+
+    void wait() {
+        std::unique_lock<std::mutex> guard(lock);
+        uint64_t gen = generation;
+        if(++waiting == threads) {
+            waiting = 0;
+            generation++;
+            wake.notify_all();
+        } else {
+            wake.wait(guard, [&]{ return generation != gen; });
+        }
+    }
+};
+
+struct MigrantSeeds {
+    int32_t epoch;
+    float seeds;
+};
+
+typedef SpscQueue<MigrantSeeds, 64> Mailbox;
+
+struct Patch {
+    World world;
+    StepController controller;
+    std::vector<Mailbox*> outgoing, incoming;
+    float emigrants = 0.0f, immigrants = 0.0f;  // this epoch
+};
+
+int runArchipelago(int argc, char **argv) {
+    int patchCount = 64, ticks = 20000, exchange = 500, neighbours = -1;
+    int workers = (int)std::max(1u, std::thread::hardware_concurrency());
+    float migration = 0.05f;
+    uint64_t seed = 1;
+    const Scenario *scenario = &SCENARIOS[0];
+    for(int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        size_t eq = arg.find('=');
+        std::string key = arg.substr(0, eq), value = eq == std::string::npos ? "" : arg.substr(eq + 1);
+        if(key == "patches") patchCount = atoi(value.c_str());
+        else if(key == "ticks") ticks = atoi(value.c_str());
+        else if(key == "exchange") exchange = atoi(value.c_str());
+        else if(key == "neighbours") neighbours = atoi(value.c_str());
+        else if(key == "workers") workers = atoi(value.c_str());
+        else if(key == "migration") migration = (float)atof(value.c_str());
+        else if(key == "seed") seed = strtoull(value.c_str(), nullptr, 10);
+        else if(key == "scenario" && findScenario(value)) scenario = findScenario(value);
+        else {
+            fprintf(stderr, "archipelago: bad argument %s\n", arg.c_str());
+            return 1;
+        }
+    }
+    if(patchCount < 1 || ticks < 1 || exchange < 1 || workers < 1) {
+        fprintf(stderr, "archipelago: patches, ticks, exchange and workers must be positive\n");
+        return 1;
+    }
+    // Neighbours are taken symmetrically, d = 1 ... neighbours/2 steps each way round the ring, so the
+    // count is even and d stops at the opposite patch. With an even patch count, d = patches/2 reaches
+    // the opposite patch from both sides; it gets one edge, so that ring has patches-1 neighbours
+    // (with two patches, each patch's one neighbour is the other).
+    int maxNeighbours = 2 * (patchCount / 2);
+    if(neighbours < 0) neighbours = std::min(4, maxNeighbours);
+    if(neighbours % 2 != 0 || neighbours > maxNeighbours) {
+        fprintf(stderr, "archipelago: neighbours must be even and at most %d for %d patches, got %d\n",
+                maxNeighbours, patchCount, neighbours);
+        return 1;
+    }
+    if(!(migration >= 0.0f && migration <= 1.0f)) {
+        fprintf(stderr, "archipelago: migration is a fraction of the seedlings and must be in [0,1], got %g\n",
+                migration);
+        return 1;
+    }
+    workers = std::min(workers, patchCount);
+
+    std::vector<Patch> patches(patchCount);
+    std::vector<std::unique_ptr<Mailbox>> mailboxes;
+    for(int i = 0; i < patchCount; i++) {
+        patches[i].world = makeWorld(*scenario, seed * 1000003ull + i);
+        for(int d = 1; d <= neighbours / 2; d++) {
+            int right = (i + d) % patchCount, left = (i - d + patchCount) % patchCount;
+            for(int side = 0; side < (left == right ? 1 : 2); side++) {  // the opposite patch gets one edge
+                int target = side == 0 ? right : left;
+                mailboxes.emplace_back(new Mailbox());
+                patches[i].outgoing.push_back(mailboxes.back().get());
+                patches[target].incoming.push_back(mailboxes.back().get());
+            }
+        }
+    }
+
+    Barrier barrier(workers);
+    int epochs = (ticks + exchange - 1) / exchange;
+    printf("Tick,PlantsAlive,Seedlings,OccupiedPatches,Migrants\n");
+
+    auto work = [&](int w) {
+        int begin = (int)((long long)patchCount * w / workers), end = (int)((long long)patchCount * (w + 1) / workers);
+        for(int epoch = 0; epoch < epochs; epoch++) {
+            double until = (double)std::min((long long)ticks, (long long)(epoch + 1) * exchange);
+            for(int i = begin; i < end; i++) {
+                Patch &p = patches[i];
+                while(p.world.time < until)
+                    p.world.step(p.controller.choose(p.world, until));
+                p.emigrants = p.outgoing.empty() ? 0.0f : p.world.emigrate(migration);
+                for(Mailbox *box : p.outgoing)
+                    box->push({epoch, p.emigrants / p.outgoing.size()});  // a full mailbox drops the seeds
+            }
+
+            barrier.wait();
+
+            for(int i = begin; i < end; i++) {
+                Patch &p = patches[i];
+                p.immigrants = 0.0f;
+                for(Mailbox *box : p.incoming)
+                    for(const MigrantSeeds *m; (m = box->front()) && m->epoch <= epoch; box->pop())
+                        p.immigrants += m->seeds;
+                p.world.immigrate(p.immigrants);
+            }
+
+            // Reporting reads every patch, so it is the one place a second barrier is needed.
+            barrier.wait();
+            if(w == 0) {
+                int alive = 0, occupied = 0;
+                float seedlings = 0.0f, migrants = 0.0f;
+                for(auto &p : patches) {
+                    int a = p.world.aliveCount();
+                    float s = p.world.seedlings.total();
+                    alive += a; seedlings += s; migrants += p.immigrants;
+                    if(a > 0 || s > 0.0f) occupied++;
+                }
+                printf("%.0f,%d,%.1f,%d,%.1f\n", until, alive, seedlings, occupied, migrants);
+                fflush(stdout);
+            }
+            barrier.wait();
+        }
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for(int w = 1; w < workers; w++) threads.emplace_back(work, w);
+    work(0);
+    for(auto &t : threads) t.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    fprintf(stderr, "%d patches x %d ticks on %d workers in %.2f s (%.0f patch-ticks/s)\n",
+            patchCount, ticks, workers, seconds, (double)patchCount * ticks / seconds);
+    return 0;
+}
+
+// ---------- Main Program ----------
+int main(int argc, char **argv) {
+    if(argc > 1 && strcmp(argv[1], "--check-step") == 0) {
+        int ticks = argc > 2 ? atoi(argv[2]) : 10000;
+        unsigned seed = argc > 3 ? (unsigned)atoi(argv[3]) : 1;
+        return runStepCheck(ticks, seed);
+    }
+    if(argc > 3 && strcmp(argv[1], "--replay") == 0)
+        return runReplay(argv[2], atoi(argv[3]));
+    if(argc > 3 && strcmp(argv[1], "--query") == 0) {
+        std::string text = argv[3];
+        for(int i = 4; i < argc; i++) text += std::string(" ") + argv[i];
+        return runQuery(argv[2], text);
+    }
+    if(argc > 1 && strcmp(argv[1], "--archipelago") == 0)
+        return runArchipelago(argc, argv);
+    if(argc > 2 && strcmp(argv[1], "--serve") == 0) {
+        int threads = argc > 3 ? atoi(argv[3]) : (int)std::max(1u, std::thread::hardware_concurrency());
+        return runServer(argv[2], threads);
+    }
+    if(argc > 3 && strcmp(argv[1], "--submit") == 0) {
+        std::string line = argv[3];
+        for(int i = 4; i < argc; i++) line += std::string(" ") + argv[i];
+        return runSubmit(argv[2], line);
+    }
+
+    const int screenWidth = 1200, screenHeight = 800;
+    const int GRID_SIZE = 40;
+    const float CELL_SIZE = 1.0f;
+    const int NUM_PLANTS = 60;
+    const float HEIGHT_SCALE = 5.0f;
+    const int KEYFRAME_INTERVAL = 1000;
+    const int HISTORY_INTERVAL = 10;
+    const int ANALYSIS_INTERVAL = 600;
+    const int SORT_INTERVAL = 3000;
+    const int SORT_DEADLINE = 120;  // frames a spatial sort may take before it is finished on the spot
+    const double FRAME_BUDGET = 1.0 / 60.0;
+
+    InitWindow(screenWidth, screenHeight, "3D Plant-Soil Ecosystem");
+    SetTargetFPS(60);
+
+    Camera3D camera = {0};
+    camera.position = {30, 20, 30};
+    camera.target = {0, 0, 0};
+    camera.up = {0,1,0};
+    camera.fovy = 45.0f;
+    camera.projection = CAMERA_PERSPECTIVE;
+
+    World world(GRID_SIZE, CELL_SIZE, HEIGHT_SCALE, NUM_PLANTS, (uint64_t)time(0));
+    StepController controller;
+
+    EventLog events("plant_events.bin", world);
+    events.observe(world, 0);
+
+    HistoryWriter plantHistory("plant_history.bin", PLANT_HISTORY_COLUMNS);
+    HistoryWriter soilHistory("soil_history.bin", SOIL_HISTORY_COLUMNS);
+
+    std::ofstream soilLog("soil_status.csv");
+    soilLog << "Frame,SoilX,SoilZ,Water,Nitrogen,Phosphorus,Potassium,Occupancy,PlantUsage\n";
+
+    BackgroundScheduler background;
+    BackgroundResults analysis;
+    FrameTimer frameTimer;
+    PopulationCharts charts;
+    double lastWork = 0.0;  // seconds the previous frame spent outside background jobs
+
+    int frame = 0;
+
+    while(!WindowShouldClose()) {
+        double frameStart = GetTime();
+
+        float speed = 10.0f * GetFrameTime();
+        if(IsKeyDown(KEY_W)) camera.position = Vector3Add(camera.position, (Vector3){0,0,-speed});
+        if(IsKeyDown(KEY_S)) camera.position = Vector3Add(camera.position, (Vector3){0,0,speed});
+        if(IsKeyDown(KEY_A)) camera.position = Vector3Add(camera.position, (Vector3){-speed,0,0});
+        if(IsKeyDown(KEY_D)) camera.position = Vector3Add(camera.position, (Vector3){speed,0,0});
+        if(IsKeyDown(KEY_SPACE)) camera.position = Vector3Add(camera.position, (Vector3){0,speed,0});
+        if(IsKeyDown(KEY_LEFT_CONTROL)) camera.position = Vector3Add(camera.position, (Vector3){0,-speed,0});
+
+        camera.target = (Vector3){0,0,0};
+
+        if(frame % KEYFRAME_INTERVAL == 0) events.keyframe(world, controller, frame);
+        if(IsKeyPressed(KEY_F)) {
+            applyIntervention(world, INTERVENE_FERTILIZE, 0.1f);
+            events.intervention(frame, INTERVENE_FERTILIZE, 0.1f);
+        }
+
+        if(frame % ANALYSIS_INTERVAL == 0) {
+            background.add(new SpatialStatsJob(world, analysis));
+            background.add(new PatchLabelJob(world, analysis));
+            if(world.plants.size() > 2 * (size_t)world.aliveCount()) background.add(new CompactionJob());
+        }
+        if(frame % SORT_INTERVAL == 0 && frame > 0) background.add(new SpatialSortJob(world, frame + SORT_DEADLINE));
+
+        double backgroundStart = GetTime();
+        background.run(FRAME_BUDGET - lastWork - 0.002, world, events, frame);
+        double backgroundTime = GetTime() - backgroundStart;
+
+        float dt = controller.choose(world);
+        world.step(dt);
+        events.observe(world, frame);
+        if(frame % HISTORY_INTERVAL == 0) recordHistory(world, frame, plantHistory, soilHistory);
+        charts.sample(world);
+        if(IsKeyPressed(KEY_TAB)) charts.selected = (charts.selected + 1) % PopulationCharts::METRICS;
+        if(IsKeyPressed(KEY_MINUS)) charts.zoomOut();
+        if(IsKeyPressed(KEY_EQUAL)) charts.zoomIn();
+
+        auto &soil = world.soil;
+        auto &plants = world.plants;
+
+        BeginDrawing();
+            ClearBackground(RAYWHITE);
+            BeginMode3D(camera);
+
+                for(auto &s : soil)
+                    DrawCube({s.position.x - GRID_SIZE/2 + 0.5f, 0, s.position.y - GRID_SIZE/2 + 0.5f},
+                             CELL_SIZE, 0.2f, CELL_SIZE, (Color){139,69,19,255});
+
+                for(auto &p : plants)
+                    if(p.alive) {
+                        DrawCube(p.position, p.size, p.size, p.size, p.color);
+                        DrawCubeWires(p.position, p.size, p.size, p.size, BLACK);
+                    }
+
+                for(size_t i = 0; i < soil.size(); i++)
+                    if(world.seedlings.count[i] > 0.0f) {
+                        float h = world.seedlings.size[i];
+                        DrawCube({soil[i].position.x - GRID_SIZE/2 + 0.5f, 0.1f + h/2, soil[i].position.y - GRID_SIZE/2 + 0.5f},
+                                 h, h, h, (Color){120,200,80,255});
+                    }
+
+            EndMode3D();
+
+            DrawText("Use WASD + Space/CTRL to move, F to fertilize.",10,10,20,DARKGRAY);
+            DrawText(TextFormat("Plants alive: %d", world.aliveCount()),10,40,20,DARKGREEN);
+            DrawText(TextFormat("Seedlings: %.0f", world.seedlings.total()),10,70,20,DARKGREEN);
+            DrawText(TextFormat("Sim time: %.0f ticks (step %.1f)", world.time, dt),10,100,20,DARKGRAY);
+            DrawText(TextFormat("Nitrogen Moran's I: %.3f  Depleted patches: %d (largest %d)",
+                        analysis.nitrogenMoran, analysis.depletedPatches, analysis.largestPatch),10,130,20,DARKGRAY);
+            DrawText(TextFormat("Frame time p99: %.1f ms", frameTimer.percentile(0.99f) * 1000.0f),10,160,20,DARKGRAY);
+            charts.draw(screenWidth - 420, screenHeight - 220, 400, 200);
+
+            lastWork = GetTime() - frameStart - backgroundTime;
+        EndDrawing();
+        frameTimer.add((float)(GetTime() - frameStart));
+
+        for(auto &[idx, usageList] : world.cellUsage) {
             int x = (int)(soil[idx].position.x);
             int z = (int)(soil[idx].position.y);
             soilLog << frame << "," << x << "," << z << "," << soil[idx].water << "," << soil[idx].nitrogen << ","
@@ -235,7 +2596,7 @@ int main() {
         frame++;
     }
 
-    plantLog.close();
+    events.finish(frame - 1);
     soilLog.close();
     CloseWindow();
     return 0;